@@ -32,6 +32,14 @@ struct Palette {
     unsigned char *pal;
 };
 
+struct Plasma {
+    int nCols, nRows;
+    unsigned char *sine;
+    unsigned char *colPhase, *rowPhase, *radius;
+    unsigned short *colTerm;
+    unsigned short speed[4];
+};
+
 /*-----------------------------------------------------------------------------
  *
  * LedGrid --
@@ -52,6 +60,7 @@ LedGrid LedGrid_Init (int nCols, int nRows) {
     lg->gamma = calloc (256, sizeof (unsigned char));
     LedGrid_SetGamma (lg, 1.0);
 
+    lg->p  = NULL;
     lg->fd = open ("/dev/spidev0.0", O_WRONLY | O_DSYNC);
 
     return lg;
@@ -360,3 +369,129 @@ void Palette_Interpolate (Palette p, int colorPosFrom, int colorPosTo) {
     }
 }
 
+/*-----------------------------------------------------------------------------
+ *
+ * Plasma --
+ *
+ */
+
+//
+// Plasma nach dem Vorbild von PixelController, aber ohne Fliesskomma-
+// Rechnung pro Pixel. Alle Winkel sind 8 Bit breit (256 entspricht einer
+// vollen Periode); die Sinus-Tabelle, die Phasen pro Spalte und Zeile sowie
+// der Abstand jedes Pixels zur Mitte werden in 'Plasma_Init' einmal
+// berechnet. Pro Bild bleiben vier Tabellen-Zugriffe und drei Additionen
+// pro Pixel; die Summe der vier Sinus-Werte ergibt den Paletten-Index.
+//
+Plasma Plasma_Init (LedGrid lg, float period) {
+    Plasma pl;
+    int col, row;
+    double cx, cy, scale;
+
+    assert (lg != NULL);
+    assert (period > 0.0);
+
+    pl = malloc (sizeof (*pl));
+    pl->nCols    = lg->nCols;
+    pl->nRows    = lg->nRows;
+    pl->sine     = calloc (256, sizeof (unsigned char));
+    pl->colPhase = calloc (pl->nCols, sizeof (unsigned char));
+    pl->rowPhase = calloc (pl->nRows, sizeof (unsigned char));
+    pl->radius   = calloc (pl->nCols * pl->nRows, sizeof (unsigned char));
+    pl->colTerm  = calloc (pl->nCols, sizeof (unsigned short));
+
+    for (col=0; col<256; col++) {
+        pl->sine[col] = (int) (127.5 + 127.5 * sin (2.0 * M_PI * col / 256.0));
+    }
+
+    scale = 256.0 / period;
+    cx = (pl->nCols - 1) / 2.0;
+    cy = (pl->nRows - 1) / 2.0;
+    for (col=0; col<pl->nCols; col++) {
+        pl->colPhase[col] = (int) (col * scale) & 0xFF;
+    }
+    for (row=0; row<pl->nRows; row++) {
+        pl->rowPhase[row] = (int) (row * scale) & 0xFF;
+        for (col=0; col<pl->nCols; col++) {
+            pl->radius[row * pl->nCols + col] = (int) (scale
+                    * sqrt ((col-cx)*(col-cx) + (row-cy)*(row-cy))) & 0xFF;
+        }
+    }
+
+    Plasma_SetSpeed (pl, 3.0, 2.0, 5.0, 4.0);
+
+    return pl;
+}
+
+void Plasma_Free (Plasma pl) {
+    assert (pl != NULL);
+
+    free (pl->sine);
+    free (pl->colPhase);
+    free (pl->rowPhase);
+    free (pl->radius);
+    free (pl->colTerm);
+    free (pl);
+}
+
+//
+// Geschwindigkeit der vier Wellen (horizontal, vertikal, diagonal, radial)
+// in 1/256 Perioden pro Bild.
+//
+void Plasma_SetSpeed (Plasma pl, float colSpeed, float rowSpeed,
+        float diagSpeed, float radSpeed) {
+    assert (pl != NULL);
+
+    pl->speed[0] = (int) (colSpeed  * 256.0);
+    pl->speed[1] = (int) (rowSpeed  * 256.0);
+    pl->speed[2] = (int) (diagSpeed * 256.0);
+    pl->speed[3] = (int) (radSpeed  * 256.0);
+}
+
+//
+// Zeichnet Bild Nummer 'frame' des Plasmas mit der Palette der LedGrid.
+// Die horizontale Welle haengt nicht von der Zeile ab und wird darum pro
+// Bild nur einmal fuer alle Spalten berechnet.
+//
+void LedGrid_DrawPlasma (LedGrid lg, Plasma pl, unsigned int frame) {
+    unsigned char t[4];
+    unsigned char *sine, *radius, *pal, *out;
+    unsigned short rowTerm;
+    unsigned char diag;
+    int i, col, row, step, idx;
+
+    assert (lg != NULL);
+    assert (pl != NULL);
+    assert (lg->p != NULL);
+    assert ((pl->nCols == lg->nCols) && (pl->nRows == lg->nRows));
+
+    for (i=0; i<4; i++) {
+        t[i] = (frame * pl->speed[i]) >> 8;
+    }
+    sine = pl->sine;
+    pal  = lg->p->pal;
+
+    for (col=0; col<pl->nCols; col++) {
+        pl->colTerm[col] = sine[(unsigned char) (pl->colPhase[col] + t[0])];
+    }
+    for (row=0; row<pl->nRows; row++) {
+        rowTerm = sine[(unsigned char) (pl->rowPhase[row] + t[1])];
+        diag    = pl->rowPhase[row] + t[2];
+        radius  = pl->radius + row * pl->nCols;
+        if (row % 2) {
+            out  = lg->strip + 3 * ((row+1) * lg->nCols - 1);
+            step = -3;
+        } else {
+            out  = lg->strip + 3 * row * lg->nCols;
+            step = 3;
+        }
+        for (col=0; col<pl->nCols; col++, out+=step) {
+            idx = (pl->colTerm[col] + rowTerm
+                    + sine[(unsigned char) (pl->colPhase[col] + diag)]
+                    + sine[(unsigned char) (radius[col] + t[3])]) >> 2;
+            out[RED]   = pal[3 * idx + RED];
+            out[GREEN] = pal[3 * idx + GREEN];
+            out[BLUE]  = pal[3 * idx + BLUE];
+        }
+    }
+}
@@ -3,6 +3,7 @@
 
 typedef struct LedGrid *LedGrid;
 typedef struct Palette *Palette;
+typedef struct Plasma *Plasma;
 
 /*-----------------------------------------------------------------------------
  *
@@ -74,5 +75,18 @@ extern void Palette_SetColorInt (Palette p, int colorPos,
 
 extern void Palette_Interpolate (Palette p, int colorPosFrom, int colorPosTo);
 
+/*-----------------------------------------------------------------------------
+ *
+ * Plasma --
+ *
+ */
+extern Plasma Plasma_Init (LedGrid lg, float period);
+extern void   Plasma_Free (Plasma pl);
+
+extern void   Plasma_SetSpeed (Plasma pl, float colSpeed, float rowSpeed,
+        float diagSpeed, float radSpeed);
+
+extern void   LedGrid_DrawPlasma (LedGrid lg, Plasma pl, unsigned int frame);
+
 #endif /* LEDGRID_INCLUDED */
 
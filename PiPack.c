@@ -12,13 +12,19 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
 #include <math.h>
 #include <assert.h>
+#include <ctype.h>
 #include <pthread.h>
 #include <errno.h>
+#include <time.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 /*
  * Semaphore --
@@ -43,6 +49,16 @@ Semaphore Semaphore_Init (int count) {
     return s;
 }
 
+void Semaphore_Free (Semaphore s) {
+    assert (s != NULL);
+
+    pthread_mutex_destroy (s->mutex);
+    pthread_cond_destroy (s->cond);
+    free (s->mutex);
+    free (s->cond);
+    free (s);
+}
+
 void Semaphore_P (Semaphore s) {
     assert (s != NULL);
 
@@ -65,6 +81,320 @@ void Semaphore_V (Semaphore s) {
     pthread_mutex_unlock (s->mutex);
 }
 
+/*
+ * PreCache --
+ */
+
+//
+// Aufbau der Datei: ein Kopf ('PreCache_Header'), danach 'numEntries'
+// Eintraege, jeder bestehend aus 'PreCache_Entry', dem Schluessel und den
+// Daten, auf 8 Bytes aufgerundet. Die Datei wird nur gelesen (mmap);
+// neue Eintraege werden im Speicher gesammelt und von 'PreCache_Save'
+// zusammen mit den alten in eine neue Datei geschrieben. Von den alten
+// Eintraegen werden nur die behalten, die seit dem Oeffnen gelesen wurden;
+// zudem werden pro Art hoechstens PRECACHE_MAXENTRIES Eintraege
+// geschrieben (die neuesten zuerst). So waechst die Datei nicht mit jeder
+// je verwendeten Kurve. Eine Datei mit falscher Kennung, Version oder
+// Byte-Reihenfolge wird ignoriert.
+//
+// Nicht gespeichert werden die Symmetrie-Tabellen der ColorGrid
+// ('symFund', 'symCopy'): sie haengen nur von der Groesse ab und sind mit
+// ein paar Vergleichen pro Pixel schneller berechnet als gesucht und
+// kopiert.
+//
+#define PRECACHE_MAGIC    "PiPack\0"
+#define PRECACHE_VERSION  1
+#define PRECACHE_ORDER    0x01020304
+#define PRECACHE_ALIGN(n) (((n) + 7) & ~7)
+#define PRECACHE_MAXENTRIES 32
+
+typedef struct PreCache_Header {
+    char magic[8];
+    uint32_t version, order;
+    uint32_t numEntries, reserved;
+} PreCache_Header;
+
+typedef struct PreCache_Entry {
+    uint32_t kind, keyLen, dataLen, reserved;
+} PreCache_Entry;
+
+typedef struct PreCache_Item {
+    PreCache_Entry entry;
+    unsigned char *buf;
+    struct PreCache_Item *next;
+} PreCache_Item;
+
+static char *PreCache_FileName = NULL;
+static unsigned char *PreCache_Map = NULL;
+static size_t PreCache_MapSize = 0;
+static int PreCache_MapEntries = 0;
+static unsigned char *PreCache_MapUsed = NULL;
+static PreCache_Item *PreCache_New = NULL;
+static int PreCache_NumNew = 0;
+static pthread_mutex_t PreCache_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t PreCache_EntrySize (PreCache_Entry *en) {
+    return PRECACHE_ALIGN(sizeof (PreCache_Entry) + en->keyLen + en->dataLen);
+}
+
+//
+// Prueft Kopf und Eintraege der eingeblendeten Datei. Liefert die Anzahl
+// Eintraege oder -1.
+//
+static int PreCache_Check (unsigned char *map, size_t size) {
+    PreCache_Header *hd;
+    PreCache_Entry *en;
+    size_t pos;
+    uint32_t i;
+
+    if (size < sizeof (PreCache_Header)) {
+        return -1;
+    }
+    hd = (PreCache_Header *) map;
+    if ((memcmp (hd->magic, PRECACHE_MAGIC, sizeof (hd->magic)) != 0)
+            || (hd->version != PRECACHE_VERSION)
+            || (hd->order != PRECACHE_ORDER)) {
+        return -1;
+    }
+    pos = sizeof (PreCache_Header);
+    for (i=0; i<hd->numEntries; i++) {
+        if (pos + sizeof (PreCache_Entry) > size) {
+            return -1;
+        }
+        en = (PreCache_Entry *) (map + pos);
+        if ((en->keyLen > size) || (en->dataLen > size)
+                || (pos + PreCache_EntrySize (en) > size)) {
+            return -1;
+        }
+        pos += PreCache_EntrySize (en);
+    }
+    return hd->numEntries;
+}
+
+//
+// Verwendet 'fileName' als Zwischenspeicher fuer vorberechnete Tabellen.
+// Existiert die Datei und ist sie gueltig, wird sie eingeblendet. Liefert
+// die Anzahl vorhandener Eintraege (0, falls die Datei fehlt oder nicht
+// verwendet werden kann). Muss vor dem Anlegen der Objekte aufgerufen
+// werden, deren Tabellen gespeichert werden sollen.
+//
+int PreCache_Open (char *fileName) {
+    struct stat st;
+    unsigned char *map;
+    int fd, num;
+
+    assert (fileName != NULL);
+
+    pthread_mutex_lock (&PreCache_Mutex);
+    free (PreCache_FileName);
+    PreCache_FileName = strdup (fileName);
+    num = 0;
+    fd = open (fileName, O_RDONLY);
+    if (fd >= 0) {
+        if ((fstat (fd, &st) == 0) && (st.st_size > 0)) {
+            map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                num = PreCache_Check (map, st.st_size);
+                if (num < 0) {
+                    munmap (map, st.st_size);
+                    num = 0;
+                } else {
+                    // Eine vorher eingeblendete Datei bleibt eingeblendet,
+                    // da noch Zeiger in sie verweisen koennen.
+                    PreCache_Map        = map;
+                    PreCache_MapSize    = st.st_size;
+                    PreCache_MapEntries = num;
+                    free (PreCache_MapUsed);
+                    PreCache_MapUsed = calloc (num + 1, 1);
+                }
+            }
+        }
+        close (fd);
+    }
+    pthread_mutex_unlock (&PreCache_Mutex);
+
+    return num;
+}
+
+//
+// Sucht den Eintrag der Art 'kind' mit dem Schluessel 'key'. Liefert einen
+// Zeiger auf dessen 'dataLen' Bytes oder NULL. Die Daten duerfen nicht
+// veraendert werden und bleiben bis zum Programmende gueltig.
+//
+const void *PreCache_Get (unsigned int kind, const void *key,
+        unsigned int keyLen, unsigned int dataLen) {
+    PreCache_Entry *en;
+    PreCache_Item *it;
+    const void *data;
+    size_t pos;
+    int i;
+
+    assert ((kind >= PRECACHE_GAMMA) && (kind <= PRECACHE_CURVE));
+    assert ((key != NULL) && (keyLen > 0) && (dataLen > 0));
+
+    data = NULL;
+    pthread_mutex_lock (&PreCache_Mutex);
+    pos = sizeof (PreCache_Header);
+    for (i=0; (i<PreCache_MapEntries) && (data == NULL); i++) {
+        en = (PreCache_Entry *) (PreCache_Map + pos);
+        if ((en->kind == kind) && (en->keyLen == keyLen)
+                && (en->dataLen == dataLen)
+                && (memcmp (en + 1, key, keyLen) == 0)) {
+            data = (unsigned char *) (en + 1) + keyLen;
+            PreCache_MapUsed[i] = 1;
+        }
+        pos += PreCache_EntrySize (en);
+    }
+    for (it=PreCache_New; (it != NULL) && (data == NULL); it=it->next) {
+        if ((it->entry.kind == kind) && (it->entry.keyLen == keyLen)
+                && (it->entry.dataLen == dataLen)
+                && (memcmp (it->buf, key, keyLen) == 0)) {
+            data = it->buf + keyLen;
+        }
+    }
+    pthread_mutex_unlock (&PreCache_Mutex);
+
+    return data;
+}
+
+//
+// Merkt sich die Daten 'data' unter dem Schluessel 'key' fuer das naechste
+// 'PreCache_Save'. Ohne 'PreCache_Open' geschieht nichts.
+//
+void PreCache_Put (unsigned int kind, const void *key, unsigned int keyLen,
+        const void *data, unsigned int dataLen) {
+    PreCache_Item *it;
+
+    assert ((kind >= PRECACHE_GAMMA) && (kind <= PRECACHE_CURVE));
+    assert ((key != NULL) && (keyLen > 0));
+    assert ((data != NULL) && (dataLen > 0));
+
+    pthread_mutex_lock (&PreCache_Mutex);
+    if (PreCache_FileName != NULL) {
+        it = malloc (sizeof (PreCache_Item));
+        it->entry.kind     = kind;
+        it->entry.keyLen   = keyLen;
+        it->entry.dataLen  = dataLen;
+        it->entry.reserved = 0;
+        it->buf = malloc (keyLen + dataLen);
+        memcpy (it->buf, key, keyLen);
+        memcpy (it->buf + keyLen, data, dataLen);
+        it->next = PreCache_New;
+        PreCache_New = it;
+        PreCache_NumNew++;
+    }
+    pthread_mutex_unlock (&PreCache_Mutex);
+}
+
+//
+// Entscheidet, ob ein Eintrag der Art 'kind' noch in die Datei kommt, und
+// zaehlt ihn in 'count' mit.
+//
+static int PreCache_Keep (int *count, uint32_t kind) {
+    if (count[kind] >= PRECACHE_MAXENTRIES) {
+        return 0;
+    }
+    count[kind]++;
+    return 1;
+}
+
+//
+// Schreibt einen Eintrag (Kopf, Schluessel und Daten, aufgefuellt auf
+// 8 Bytes). Liefert 1 bei Erfolg.
+//
+static int PreCache_Write (FILE *fd, PreCache_Entry *en,
+        const unsigned char *buf) {
+    static const unsigned char zero[8] = { 0 };
+    size_t len, pad;
+
+    len = en->keyLen + en->dataLen;
+    pad = PreCache_EntrySize (en) - sizeof (PreCache_Entry) - len;
+    return (fwrite (en, sizeof (PreCache_Entry), 1, fd) == 1)
+            && (fwrite (buf, 1, len, fd) == len)
+            && (fwrite (zero, 1, pad, fd) == pad);
+}
+
+//
+// Schreibt die neuen und die gelesenen alten Eintraege in die Datei von
+// 'PreCache_Open', falls seit dem Oeffnen neue dazugekommen sind. Die
+// Datei wird zuerst unter einem temporaeren Namen geschrieben und dann
+// umbenannt, damit ein Abbruch nie eine halbe Datei hinterlaesst. Liefert
+// 0 oder -1 bei einem Fehler.
+//
+int PreCache_Save (void) {
+    PreCache_Header hd;
+    PreCache_Entry *en;
+    PreCache_Item *it;
+    int count[PRECACHE_CURVE+1];
+    char *tmpName;
+    FILE *fd;
+    size_t pos;
+    int i, num, ok;
+
+    pthread_mutex_lock (&PreCache_Mutex);
+    if ((PreCache_FileName == NULL) || (PreCache_NumNew == 0)) {
+        pthread_mutex_unlock (&PreCache_Mutex);
+        return 0;
+    }
+    tmpName = malloc (strlen (PreCache_FileName) + 5);
+    sprintf (tmpName, "%s.tmp", PreCache_FileName);
+    fd = fopen (tmpName, "wb");
+    if (fd == NULL) {
+        pthread_mutex_unlock (&PreCache_Mutex);
+        free (tmpName);
+        return -1;
+    }
+
+    // Erster Durchgang nur zum Zaehlen, der zweite schreibt dieselben
+    // Eintraege in derselben Reihenfolge.
+    memset (count, 0, sizeof (count));
+    num = 0;
+    for (it=PreCache_New; it != NULL; it=it->next) {
+        num += PreCache_Keep (count, it->entry.kind);
+    }
+    pos = sizeof (PreCache_Header);
+    for (i=0; i<PreCache_MapEntries; i++) {
+        en = (PreCache_Entry *) (PreCache_Map + pos);
+        if (PreCache_MapUsed[i]) {
+            num += PreCache_Keep (count, en->kind);
+        }
+        pos += PreCache_EntrySize (en);
+    }
+
+    memset (&hd, 0, sizeof (hd));
+    memcpy (hd.magic, PRECACHE_MAGIC, sizeof (hd.magic));
+    hd.version    = PRECACHE_VERSION;
+    hd.order      = PRECACHE_ORDER;
+    hd.numEntries = num;
+    ok = (fwrite (&hd, sizeof (hd), 1, fd) == 1);
+
+    memset (count, 0, sizeof (count));
+    for (it=PreCache_New; it != NULL; it=it->next) {
+        if (PreCache_Keep (count, it->entry.kind)) {
+            ok = ok && PreCache_Write (fd, &it->entry, it->buf);
+        }
+    }
+    pos = sizeof (PreCache_Header);
+    for (i=0; i<PreCache_MapEntries; i++) {
+        en = (PreCache_Entry *) (PreCache_Map + pos);
+        if (PreCache_MapUsed[i] && PreCache_Keep (count, en->kind)) {
+            ok = ok && PreCache_Write (fd, en,
+                    (unsigned char *) (en + 1));
+        }
+        pos += PreCache_EntrySize (en);
+    }
+    ok = (fclose (fd) == 0) && ok;
+    if (ok) {
+        ok = (rename (tmpName, PreCache_FileName) == 0);
+    } else {
+        unlink (tmpName);
+    }
+    pthread_mutex_unlock (&PreCache_Mutex);
+    free (tmpName);
+
+    return ok ? 0 : -1;
+}
+
 /*
  * Button --
  */
@@ -354,12 +684,30 @@ LedFader LedFader_Init (int ledPin, int buttonPin) {
 #define PIPACK_SPI_CHANNEL       0
 #define PIPACK_SPI_SPEED   4000000
 
+//
+// Die Farbwerte werden als Ringpuffer gehalten: 'head' ist die Position des
+// logischen Pixels 0 in 'array'. Damit sind 'LedStrip_Cycle' und
+// 'LedStrip_PushColor' reine Verschiebungen von 'head'.
+//
 struct LedStrip {
     int fd;
     int size;
+    int head;
     unsigned char *array, *output, *gamma;
+    unsigned short *calib;
 };
 
+//
+// Liefert den Index des ersten Bytes von Pixel 'pixel' in 'array'.
+//
+static int LedStrip_Index (LedStrip ls, int pixel) {
+    pixel += ls->head;
+    if (pixel >= ls->size) {
+        pixel -= ls->size;
+    }
+    return 3 * pixel;
+}
+
 LedStrip LedStrip_Init (int size, float gammaValue) {
     LedStrip ls;
     int i;
@@ -374,9 +722,11 @@ LedStrip LedStrip_Init (int size, float gammaValue) {
     }
 //    ls->fd = open ("/dev/spidev0.0", O_WRONLY | O_DSYNC);
     ls->size = size;
+    ls->head = 0;
     ls->array = calloc (size, 3 * sizeof (unsigned char));
     ls->output = calloc (size, 3 * sizeof (unsigned char));
     ls->gamma = calloc (256, sizeof (unsigned char));
+    ls->calib = NULL;
     LedStrip_SetGamma (ls, gammaValue);
 
     return ls;
@@ -389,17 +739,47 @@ void LedStrip_Free (LedStrip ls) {
     free (ls->array);
     free (ls->output);
     free (ls->gamma);
+    free (ls->calib);
     free (ls);
 }
 
+//
+// Uebertraegt 'n' Bytes ab 'src' mit Gamma-Korrektur und (falls vorhanden)
+// Kalibrierung nach 'ls->output' ab Position 'pos'.
+//
+static void LedStrip_Output (LedStrip ls, unsigned char *src, int pos, int n) {
+    unsigned char *out;
+    unsigned short *calib;
+    int i, v;
+
+    out = ls->output + pos;
+    if (ls->calib == NULL) {
+        for (i=0; i<n; i++) {
+            out[i] = ls->gamma[src[i]];
+        }
+    } else {
+        calib = ls->calib + pos;
+        for (i=0; i<n; i++) {
+            v = (ls->gamma[src[i]] * calib[i]) >> 8;
+            out[i] = (v > 255) ? 255 : v;
+        }
+    }
+}
+
 void LedStrip_Show (LedStrip ls) {
-    int i;
+    int n;
 
     assert (ls != NULL);
 
-    for (i=0; i<3*ls->size; i++) {
-        ls->output[i] = ls->gamma[ls->array[i]];
-    }
+    //
+    // Gamma und (falls vorhanden) die Kalibrierung pro LED werden im
+    // gleichen Durchgang angewendet. Die Kalibrierung ist ein 8.8 Faktor
+    // (256 entspricht 1.0) pro Farbkanal und LED. Der Ringpuffer wird dabei
+    // in zwei zusammenhaengenden Teilstuecken ausgegeben.
+    //
+    n = 3 * (ls->size - ls->head);
+    LedStrip_Output (ls, ls->array + 3 * ls->head, 0, n);
+    LedStrip_Output (ls, ls->array, n, 3 * ls->head);
     if (wiringPiSPIDataRW(PIPACK_SPI_CHANNEL, ls->output, 3 * ls->size) < 0) {
         fprintf(stderr, "SPI failure: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
@@ -409,57 +789,124 @@ void LedStrip_Show (LedStrip ls) {
 }
 
 void LedStrip_SetGamma (LedStrip ls, float gammaValue) {
+    const void *data;
     int i;
 
     assert (ls != NULL);
 
+    data = PreCache_Get (PRECACHE_GAMMA, &gammaValue, sizeof (gammaValue),
+            256);
+    if (data != NULL) {
+        memcpy (ls->gamma, data, 256);
+        return;
+    }
     for (i=0; i<256; i++) {
         ls->gamma[i] = (unsigned char) (255.0 * pow ((float)i/255.0, gammaValue) + 0.5);
     }
+    PreCache_Put (PRECACHE_GAMMA, &gammaValue, sizeof (gammaValue),
+            ls->gamma, 256);
+}
+
+void LedStrip_SetCalibration (LedStrip ls, int pixel,
+        float red, float green, float blue) {
+    int i;
+
+    assert (ls != NULL);
+    assert ((pixel >= 0) && (pixel < ls->size));
+    assert ((red >= 0.0) && (green >= 0.0) && (blue >= 0.0));
+
+    if (ls->calib == NULL) {
+        ls->calib = calloc (ls->size, 3 * sizeof (unsigned short));
+        for (i=0; i<3*ls->size; i++) {
+            ls->calib[i] = 256;
+        }
+    }
+    ls->calib[3 * pixel + RED]   = (red   > 255.0) ? 0xFFFF : 256.0 * red   + 0.5;
+    ls->calib[3 * pixel + GREEN] = (green > 255.0) ? 0xFFFF : 256.0 * green + 0.5;
+    ls->calib[3 * pixel + BLUE]  = (blue  > 255.0) ? 0xFFFF : 256.0 * blue  + 0.5;
+}
+
+//
+// Liest eine Kalibrierungsdatei ein. Jede Zeile enthaelt die Nummer der LED
+// (in der Reihenfolge auf dem Strip) und die drei Korrekturfaktoren fuer
+// Rot, Gruen und Blau (z.B. "17 1.00 0.92 0.85"). LED's, die in der Datei
+// nicht aufgefuehrt sind, werden nicht korrigiert.
+//
+int LedStrip_LoadCalibration (LedStrip ls, char *fileName) {
+    FILE *fd;
+    int pixel;
+    float red, green, blue;
+
+    assert (ls != NULL);
+    assert (fileName != NULL);
+
+    fd = fopen (fileName, "r");
+    if (fd == NULL) {
+        return -1;
+    }
+    while (fscanf (fd, "%d %f %f %f", &pixel, &red, &green, &blue) == 4) {
+        if ((pixel < 0) || (pixel >= ls->size)) {
+            continue;
+        }
+        LedStrip_SetCalibration (ls, pixel, red, green, blue);
+    }
+    fclose (fd);
+
+    return 0;
+}
+
+void LedStrip_ClearCalibration (LedStrip ls) {
+    assert (ls != NULL);
+
+    free (ls->calib);
+    ls->calib = NULL;
 }
 
 void LedStrip_SetColor (LedStrip ls, int pixel,
         unsigned char red, unsigned char green, unsigned char blue) {
+    int i;
+
     assert (ls != NULL);
     assert (pixel < ls->size);
 
-    ls->array[3 * pixel + 0] = red;
-    ls->array[3 * pixel + 1] = green;
-    ls->array[3 * pixel + 2] = blue;
+    i = LedStrip_Index (ls, pixel);
+    ls->array[i + 0] = red;
+    ls->array[i + 1] = green;
+    ls->array[i + 2] = blue;
 }
 
 void LedStrip_SetColorValue (LedStrip ls, int pixel,
         enum LedStrip_ColorIndexEnum colorIndex, unsigned char value) {
-    ls->array[3 * pixel + colorIndex] = value;
+    ls->array[LedStrip_Index (ls, pixel) + colorIndex] = value;
 }
 
 void LedStrip_SetRed (LedStrip ls, int pixel, unsigned char red) {
-    ls->array[3 * pixel + 0] = red;
+    ls->array[LedStrip_Index (ls, pixel) + 0] = red;
 }
 
 void LedStrip_SetGreen (LedStrip ls, int pixel, unsigned char green) {
-    ls->array[3 * pixel + 1] = green;
+    ls->array[LedStrip_Index (ls, pixel) + 1] = green;
 }
 
 void LedStrip_SetBlue (LedStrip ls, int pixel, unsigned char blue) {
-    ls->array[3 * pixel + 2] = blue;
+    ls->array[LedStrip_Index (ls, pixel) + 2] = blue;
 }
 
 unsigned char LedStrip_GetColorValue (LedStrip ls, int pixel,
         enum LedStrip_ColorIndexEnum colorIndex) {
-    return ls->array[3 * pixel + colorIndex];
+    return ls->array[LedStrip_Index (ls, pixel) + colorIndex];
 }
 
 unsigned char LedStrip_GetRed (LedStrip ls, int pixel) {
-    return ls->array[3 * pixel + 0];
+    return ls->array[LedStrip_Index (ls, pixel) + 0];
 }
 
 unsigned char LedStrip_GetGreen (LedStrip ls, int pixel) {
-    return ls->array[3 * pixel + 1];
+    return ls->array[LedStrip_Index (ls, pixel) + 1];
 }
 
 unsigned char LedStrip_GetBlue (LedStrip ls, int pixel) {
-    return ls->array[3 * pixel + 2];
+    return ls->array[LedStrip_Index (ls, pixel) + 2];
 }
 
 void LedStrip_SetValue (LedStrip ls, int pixel, unsigned char value) {
@@ -467,35 +914,20 @@ void LedStrip_SetValue (LedStrip ls, int pixel, unsigned char value) {
 }
 
 unsigned char LedStrip_GetValue (LedStrip ls, int pixel) {
-    return ls->array[3 * pixel];
+    return ls->array[LedStrip_Index (ls, pixel)];
 }
 
 void LedStrip_Cycle (LedStrip ls) {
-    int i;
-    unsigned char red, green, blue;
+    assert (ls != NULL);
 
-    red   = ls->array[3 * (ls->size-1) + 0];
-    green = ls->array[3 * (ls->size-1) + 1];
-    blue  = ls->array[3 * (ls->size-1) + 2];
-    for (i=ls->size-1; i>0; i--) {
-        ls->array[3 * i + 0] = ls->array[3 * (i-1) + 0];
-        ls->array[3 * i + 1] = ls->array[3 * (i-1) + 1];
-        ls->array[3 * i + 2] = ls->array[3 * (i-1) + 2];
-    }
-    ls->array[0] = red;
-    ls->array[1] = green;
-    ls->array[2] = blue;
+    ls->head = (ls->head == 0) ? ls->size-1 : ls->head-1;
 }
 
 void LedStrip_PushColor (LedStrip ls,
         unsigned char red, unsigned char green, unsigned char blue) {
-    int i;
+    assert (ls != NULL);
 
-    for (i=ls->size-1; i>0; i--) {
-        ls->array[3 * i + 0] = ls->array[3 * (i-1) + 0];
-        ls->array[3 * i + 1] = ls->array[3 * (i-1) + 1];
-        ls->array[3 * i + 2] = ls->array[3 * (i-1) + 2];
-    }
+    ls->head = (ls->head == 0) ? ls->size-1 : ls->head-1;
     LedStrip_SetColor (ls, 0, red, green, blue);
 }
 
@@ -537,10 +969,100 @@ void LedStrip_Fade (LedStrip ls) {
 // V1.0
 //
 
+//
+// Das Bild, in welches die Set- und Get-Funktionen zeichnen. Solange kein
+// eigenes Bild gesetzt ist (drawImage < 0), ist dies das aktuelle Bild.
+//
+#define LEDGRID_DRAWIMAGE(lg) \
+    (((lg)->drawImage < 0) ? (lg)->curImage : (lg)->drawImage)
+
+typedef struct LedLayer {
+    int image;
+    int alpha;
+    enum LedGrid_BlendModeEnum mode;
+    int visible;
+} LedLayer;
+
+//
+// Zeitgesteuerter Uebergang zwischen zwei beliebigen Bildern. Ausgewertet
+// wird er von 'LedGrid_Show' anhand der seit dem Start verstrichenen Zeit,
+// 'weight' ist das Gewicht (0..256) des Zielbildes fuer den aktuellen Frame.
+//
+typedef struct LedTransition {
+    int active;
+    int from, to;
+    int duration;
+    enum LedGrid_EasingEnum easing;
+    enum LedGrid_TransitionEnum effect;
+    struct timespec start;
+    int weight;
+} LedTransition;
+
+#define LEDGRID_EASE_STEPS 256
+
+static unsigned short LedGrid_EaseTable[EASE_IN_OUT+1][LEDGRID_EASE_STEPS+1];
+static int LedGrid_EaseTableInit = 0;
+
+static void LedGrid_InitEaseTable (void) {
+    const void *data;
+    int i, key;
+    double t;
+
+    if (LedGrid_EaseTableInit) {
+        return;
+    }
+    key  = LEDGRID_EASE_STEPS;
+    data = PreCache_Get (PRECACHE_EASE, &key, sizeof (key),
+            sizeof (LedGrid_EaseTable));
+    if (data != NULL) {
+        memcpy (LedGrid_EaseTable, data, sizeof (LedGrid_EaseTable));
+        LedGrid_EaseTableInit = 1;
+        return;
+    }
+    for (i=0; i<=LEDGRID_EASE_STEPS; i++) {
+        t = (double) i / (double) LEDGRID_EASE_STEPS;
+        LedGrid_EaseTable[EASE_LINEAR][i] = 256.0 * t + 0.5;
+        LedGrid_EaseTable[EASE_IN][i]     = 256.0 * t * t + 0.5;
+        LedGrid_EaseTable[EASE_OUT][i]    = 256.0 * (1.0 - (1.0-t)*(1.0-t)) + 0.5;
+        LedGrid_EaseTable[EASE_IN_OUT][i] = 256.0 * (1.0 - cos (M_PI*t)) / 2.0 + 0.5;
+    }
+    PreCache_Put (PRECACHE_EASE, &key, sizeof (key), LedGrid_EaseTable,
+            sizeof (LedGrid_EaseTable));
+    LedGrid_EaseTableInit = 1;
+}
+
+//
+// Groesse und Verschiebung des Ursprungs eines Bildes. Das logische Pixel
+// (x,y) liegt physisch bei ((x+originX) mod sizeX, (y+originY) mod sizeY).
+// Rotierendes Schieben veraendert damit nur den Ursprung und keine
+// Pixeldaten. Bilder koennen groesser als das Panel sein ('Canvas'); in
+// diesem Fall bestimmt (viewX,viewY) den angezeigten Ausschnitt. Bilder
+// von Ebenen ('isLayer') gehoeren nicht zur Folge der Einzelbilder und
+// werden beim Ueberblenden zum naechsten Bild uebersprungen.
+//
+typedef struct LedImage {
+    int sizeX, sizeY;
+    int originX, originY;
+    int viewX, viewY;
+    int isLayer;
+} LedImage;
+
 struct LedGrid {
     int sizeX, sizeY, size;
     int numImages, curImage, fadeStep;
+    int drawImage;
     unsigned char ***field;
+    LedImage *image;
+    int numLayers;
+    LedLayer *layer;
+    LedTransition trans;
+    unsigned short *mask[TRANSITION_SLIDE_LEFT];
+    unsigned char *row, *tmp[2];
+    enum LedGrid_BlurEnum blurType;
+    int blurRadius, *blurKernel;
+    int blurSize, blurWidth;
+    unsigned short *blurMid, *blurPad;
+    int *blurAcc;
     int startByte;
 #ifdef LEDGRID_V1
     int fd;
@@ -552,6 +1074,46 @@ struct LedGrid {
     Semaphore sem;
 };
 
+static void LedGrid_AllocImage (LedGrid lg, int img, int sizeX, int sizeY) {
+    int i;
+
+    lg->field[img] = calloc (sizeY, sizeof (unsigned char *));
+    for (i=0; i<sizeY; i++) {
+        lg->field[img][i] = calloc (sizeX, 3 * sizeof (unsigned char));
+    }
+    lg->image[img].sizeX   = sizeX;
+    lg->image[img].sizeY   = sizeY;
+    lg->image[img].originX = 0;
+    lg->image[img].originY = 0;
+    lg->image[img].viewX   = 0;
+    lg->image[img].viewY   = 0;
+    lg->image[img].isLayer = 0;
+}
+
+//
+// Liefert den Index des naechsten Einzelbildes nach 'img' (Ebenen werden
+// uebersprungen). Mit 'wrap' wird nach dem letzten Bild wieder vorne
+// begonnen, sonst wird 'numImages' geliefert, falls kein Einzelbild mehr
+// folgt.
+//
+static int LedGrid_NextFrame (LedGrid lg, int img, int wrap) {
+    int i, next;
+
+    for (i=1; i<=lg->numImages; i++) {
+        next = img + i;
+        if (next >= lg->numImages) {
+            if (! wrap) {
+                return lg->numImages;
+            }
+            next -= lg->numImages;
+        }
+        if (! lg->image[next].isLayer) {
+            return next;
+        }
+    }
+    return img;
+}
+
 LedGrid LedGrid_Init (int sizeX, int sizeY, float gammaValue) {
     LedGrid lg;
     int i;
@@ -562,12 +1124,28 @@ LedGrid LedGrid_Init (int sizeX, int sizeY, float gammaValue) {
     lg->numImages = 1;
     lg->curImage  = 0;
     lg->fadeStep  = 0;
+    lg->drawImage = -1;
 
     lg->field    = calloc (lg->numImages, sizeof (unsigned char **));
-    lg->field[lg->curImage] = calloc (lg->sizeY, sizeof (unsigned char *));
-    for (i=0; i<sizeY; i++) {
-        lg->field[lg->curImage][i] = calloc (lg->sizeX, 3 * sizeof (unsigned char));
+    lg->image    = calloc (lg->numImages, sizeof (LedImage));
+    LedGrid_AllocImage (lg, lg->curImage, lg->sizeX, lg->sizeY);
+    lg->numLayers = 0;
+    lg->layer     = NULL;
+    lg->trans.active = 0;
+    for (i=0; i<TRANSITION_SLIDE_LEFT; i++) {
+        lg->mask[i] = NULL;
     }
+    LedGrid_InitEaseTable ();
+    lg->row       = calloc (lg->sizeX, 3 * sizeof (unsigned char));
+    lg->tmp[0]    = calloc (lg->sizeX, 3 * sizeof (unsigned char));
+    lg->tmp[1]    = calloc (lg->sizeX, 3 * sizeof (unsigned char));
+    lg->blurKernel = NULL;
+    lg->blurSize   = 0;
+    lg->blurWidth  = 0;
+    lg->blurMid    = NULL;
+    lg->blurPad    = NULL;
+    lg->blurAcc    = NULL;
+    LedGrid_SetBlur (lg, BLUR_BOX, 1);
     lg->startByte = 3 * (LEDSTRIP_MAXLENGTH - (lg->sizeX * lg->sizeY));
 
 #ifdef LEDGRID_V1
@@ -588,12 +1166,24 @@ void LedGrid_Free (LedGrid lg) {
     assert (lg != NULL);
 
     for (i=0; i<lg->numImages; i++) {
-        for (j=0; j<lg->sizeY; j++) {
+        for (j=0; j<lg->image[i].sizeY; j++) {
             free (lg->field[i][j]);
         }
         free (lg->field[i]);
     }
     free (lg->field);
+    free (lg->image);
+    free (lg->layer);
+    for (i=0; i<TRANSITION_SLIDE_LEFT; i++) {
+        free (lg->mask[i]);
+    }
+    free (lg->row);
+    free (lg->tmp[0]);
+    free (lg->tmp[1]);
+    free (lg->blurKernel);
+    free (lg->blurMid);
+    free (lg->blurPad);
+    free (lg->blurAcc);
 #ifdef LEDGRID_V1
     free (lg->array);
 #endif
@@ -604,98 +1194,507 @@ void LedGrid_Free (LedGrid lg) {
     free (lg);
 }
 
-void LedGrid_Show (LedGrid lg) {
-    int i, j, k, l;
-    int v1, v2, v;
-
-    assert (lg != NULL);
+//
+// Bestimmt das Gewicht des Zielbildes eines laufenden Uebergangs fuer den
+// aktuellen Frame. Ist die Dauer abgelaufen, wird das Zielbild zum
+// aktuellen Bild und der Uebergang beendet.
+//
+static void LedGrid_UpdateTransition (LedGrid lg) {
+    LedTransition *tr;
+    struct timespec now;
+    long elapsed;
 
-    Semaphore_P (lg->sem);
-    k = lg->startByte;
-    for (i=0; i<lg->sizeY; i++) {
-        if (i%2 == 0) {
-            for (l=0; l<3*lg->sizeX; l++) {
-                if (lg->fadeStep == 0) {
-                    v  = lg->field[lg->curImage][i][l];
-                } else {
-                    v1 = lg->field[lg->curImage][i][l];
-                    v2 = lg->field[(lg->curImage+1)%lg->numImages][i][l];
-                    v = v1 + lg->fadeStep * (v2-v1) / 100;
-                }
-#ifdef LEDGRID_V1
-                lg->array[k++] = v;
-#endif
-#ifdef LEDGRID_V2
-                lg->ls->array[k++] = v;
-#endif
-            }
-        } else {
-            for (j=lg->sizeX-1; j>=0; j--) {
-                for (l=0; l<3; l++) {
-		    if (lg->fadeStep == 0) {
-			v  = lg->field[lg->curImage][i][3*j+l];
-		    } else {
-			v1 = lg->field[lg->curImage][i][3*j+l];
-			v2 = lg->field[(lg->curImage+1)%lg->numImages][i][3*j+l];
-			v = v1 + lg->fadeStep * (v2-v1) / 100;
-		    }
-#ifdef LEDGRID_V1
-                    lg->array[k++] = v;
-#endif
-#ifdef LEDGRID_V2
-                    lg->ls->array[k++] = v;
-#endif
-                }
-            }
-        }
+    tr = &lg->trans;
+    if (! tr->active) {
+        return;
     }
-#ifdef LEDGRID_V1
-    write (lg->fd, lg->array, 3 * LEDSTRIP_MAXLENGTH);
-    fsync (lg->fd);
-#endif
-#ifdef LEDGRID_V2
-    LedStrip_Show (lg->ls);
-#endif
-    Semaphore_V (lg->sem);
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - tr->start.tv_sec) * 1000
+            + (now.tv_nsec - tr->start.tv_nsec) / 1000000;
+    if (elapsed >= tr->duration) {
+        tr->active = 0;
+        lg->curImage = tr->to;
+        lg->fadeStep = 0;
+        return;
+    }
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+    tr->weight = LedGrid_EaseTable[tr->easing]
+            [elapsed * LEDGRID_EASE_STEPS / tr->duration];
 }
 
-void LedGrid_SetGamma (LedGrid lg, float gammaValue) {
-    assert (lg != NULL);
-
-    LedStrip_SetGamma (lg->ls, gammaValue);
+//
+// Liefert einen Zeiger auf das logische Pixel (x,y) des Bildes 'img'.
+//
+static unsigned char *LedGrid_Pixel (LedGrid lg, int img, int x, int y) {
+    LedImage *im;
+
+    im = &lg->image[img];
+    x += im->originX;
+    y += im->originY;
+    if (x >= im->sizeX) {
+        x -= im->sizeX;
+    }
+    if (y >= im->sizeY) {
+        y -= im->sizeY;
+    }
+    return &lg->field[img][y][3 * x];
 }
 
-void LedGrid_SetColor (LedGrid lg, int x, int y, unsigned char red,
-        unsigned char green, unsigned char blue) {
-    LedGrid_SetColorValue (lg, x, y, RED, red);
-    LedGrid_SetColorValue (lg, x, y, GREEN, green);
-    LedGrid_SetColorValue (lg, x, y, BLUE, blue);
+//
+// Kopiert die Zeile 'y' des Panels aus dem Bild 'img' nach 'dst'. Der
+// Ausschnitt ergibt sich aus Ursprung und Viewport des Bildes; er besteht
+// aus hoechstens zwei zusammenhaengenden Teilstuecken.
+//
+static void LedGrid_CopyRow (LedGrid lg, int img, int y, unsigned char *dst) {
+    LedImage *im;
+    unsigned char *src;
+    int x, n;
+
+    im = &lg->image[img];
+    y = (y + im->viewY + im->originY) % im->sizeY;
+    x = (im->viewX + im->originX) % im->sizeX;
+    src = lg->field[img][y];
+    n = im->sizeX - x;
+    if (n >= lg->sizeX) {
+        memcpy (dst, src + 3*x, 3*lg->sizeX);
+    } else {
+        memcpy (dst, src + 3*x, 3*n);
+        memcpy (dst + 3*n, src, 3*(lg->sizeX-n));
+    }
 }
 
-void LedGrid_SetColorValue (LedGrid lg, int x, int y,
-        enum LedStrip_ColorIndexEnum colorIndex, unsigned char value) {
-    assert (lg != NULL);
-    assert ((x >= 0) && (y >= 0));
-    assert ((colorIndex >= RED) && (colorIndex <= BLUE));
-    assert ((value >= 0) && (value < 256));
-
-    lg->field[lg->curImage][y][3 * x + colorIndex] = value;
+//
+// Wie 'LedGrid_CopyRow', kopiert wird aber nur, wenn der Ausschnitt nicht
+// zusammenhaengend ist. Sonst wird direkt ein Zeiger in die Zeile des
+// Bildes zurueckgegeben.
+//
+static unsigned char *LedGrid_ImageRow (LedGrid lg, int img, int y,
+        unsigned char *tmp) {
+    LedImage *im;
+    int x;
+
+    im = &lg->image[img];
+    x = (im->viewX + im->originX) % im->sizeX;
+    if (x + lg->sizeX <= im->sizeX) {
+        y = (y + im->viewY + im->originY) % im->sizeY;
+        return lg->field[img][y] + 3*x;
+    }
+    LedGrid_CopyRow (lg, img, y, tmp);
+    return tmp;
 }
 
-void LedGrid_SetValue (LedGrid lg, int x, int y, unsigned char value) {
-    LedGrid_SetColor (lg, x, y, value, value, value);
+//
+// Kehrt die Reihenfolge von 'n' Pixeln bzw. 'n' Zeilenzeigern um. Zwei
+// Umkehrungen der Teilstuecke und eine des Ganzen ergeben eine Rotation,
+// die ohne Zwischenpuffer auskommt.
+//
+static void LedGrid_ReversePixels (unsigned char *row, int n) {
+    unsigned char t;
+    int i, j, k;
+
+    for (i=0, j=n-1; i<j; i++, j--) {
+        for (k=0; k<3; k++) {
+            t = row[3*i+k];
+            row[3*i+k] = row[3*j+k];
+            row[3*j+k] = t;
+        }
+    }
 }
 
-void LedGrid_SetRed (LedGrid lg, int x, int y, unsigned char value) {
-    LedGrid_SetColorValue (lg, x, y, RED, value);
-}
+static void LedGrid_ReverseRows (unsigned char **rows, int n) {
+    unsigned char *t;
+    int i, j;
 
-void LedGrid_SetGreen (LedGrid lg, int x, int y, unsigned char value) {
-    LedGrid_SetColorValue (lg, x, y, GREEN, value);
+    for (i=0, j=n-1; i<j; i++, j--) {
+        t = rows[i];
+        rows[i] = rows[j];
+        rows[j] = t;
+    }
 }
 
-void LedGrid_SetBlue (LedGrid lg, int x, int y, unsigned char value) {
-    LedGrid_SetColorValue (lg, x, y, BLUE, value);
+//
+// Schreibt den Ursprung des Bildes in die Pixeldaten zurueck. Wird von
+// den Funktionen verwendet, die auf dem ganzen Bild arbeiten; die
+// Rotation geschieht an Ort und Stelle.
+//
+static void LedGrid_NormalizeImage (LedGrid lg, int img) {
+    LedImage *im;
+    int y, ox, oy;
+
+    im = &lg->image[img];
+    ox = im->originX;
+    if (ox != 0) {
+        for (y=0; y<im->sizeY; y++) {
+            LedGrid_ReversePixels (lg->field[img][y], ox);
+            LedGrid_ReversePixels (lg->field[img][y] + 3*ox, im->sizeX-ox);
+            LedGrid_ReversePixels (lg->field[img][y], im->sizeX);
+        }
+        im->originX = 0;
+    }
+    oy = im->originY;
+    if (oy != 0) {
+        LedGrid_ReverseRows (lg->field[img], oy);
+        LedGrid_ReverseRows (lg->field[img] + oy, im->sizeY-oy);
+        LedGrid_ReverseRows (lg->field[img], im->sizeY);
+        im->originY = 0;
+    }
+}
+
+//
+// Berechnet die Maske fuer einen Uebergang. Jedes Pixel erhaelt einen
+// Schwellwert (0..65535); sobald das Gewicht des Uebergangs diesen Wert
+// uebersteigt, wird das Pixel aus dem Zielbild genommen. Die Masken haengen
+// nur von der Geometrie ab und werden pro Grid einmal berechnet.
+//
+static unsigned short *LedGrid_GetMask (LedGrid lg,
+        enum LedGrid_TransitionEnum effect) {
+    unsigned short *mask;
+    int x, y, i, j, t, n;
+    int *perm;
+    double cx, cy, d, dMax;
+
+    if (lg->mask[effect] != NULL) {
+        return lg->mask[effect];
+    }
+    n = lg->sizeX * lg->sizeY;
+    mask = calloc (n, sizeof (unsigned short));
+    switch (effect) {
+        case TRANSITION_WIPE_LEFT:
+            for (y=0; y<lg->sizeY; y++) {
+                for (x=0; x<lg->sizeX; x++) {
+                    mask[y*lg->sizeX+x] = (lg->sizeX-1-x) * 65536 / lg->sizeX;
+                }
+            }
+            break;
+        case TRANSITION_WIPE_RIGHT:
+            for (y=0; y<lg->sizeY; y++) {
+                for (x=0; x<lg->sizeX; x++) {
+                    mask[y*lg->sizeX+x] = x * 65536 / lg->sizeX;
+                }
+            }
+            break;
+        case TRANSITION_WIPE_UP:
+            for (y=0; y<lg->sizeY; y++) {
+                for (x=0; x<lg->sizeX; x++) {
+                    mask[y*lg->sizeX+x] = (lg->sizeY-1-y) * 65536 / lg->sizeY;
+                }
+            }
+            break;
+        case TRANSITION_WIPE_DOWN:
+            for (y=0; y<lg->sizeY; y++) {
+                for (x=0; x<lg->sizeX; x++) {
+                    mask[y*lg->sizeX+x] = y * 65536 / lg->sizeY;
+                }
+            }
+            break;
+        case TRANSITION_IRIS:
+            cx = (lg->sizeX - 1) / 2.0;
+            cy = (lg->sizeY - 1) / 2.0;
+            dMax = sqrt (cx*cx + cy*cy) + 0.5;
+            for (y=0; y<lg->sizeY; y++) {
+                for (x=0; x<lg->sizeX; x++) {
+                    d = sqrt ((x-cx)*(x-cx) + (y-cy)*(y-cy));
+                    mask[y*lg->sizeX+x] = 65535.0 * d / dMax;
+                }
+            }
+            break;
+        case TRANSITION_DISSOLVE:
+            perm = calloc (n, sizeof (int));
+            for (i=0; i<n; i++) {
+                perm[i] = i;
+            }
+            for (i=n-1; i>0; i--) {
+                j = random () % (i+1);
+                t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+            }
+            for (i=0; i<n; i++) {
+                mask[perm[i]] = (long) i * 65536 / n;
+            }
+            free (perm);
+            break;
+        default:
+            break;
+    }
+    lg->mask[effect] = mask;
+
+    return mask;
+}
+
+//
+// Berechnet die Zeile 'y' eines laufenden Uebergangs. Masken-Effekte sind
+// ein reiner Vergleich gegen den Schwellwert, Slides bestehen aus zwei
+// zusammenhaengenden Teilstuecken aus Quell- und Zielbild.
+//
+static void LedGrid_TransitionRow (LedGrid lg, int y, unsigned char *row) {
+    unsigned char *src1, *src2;
+    unsigned short *mask;
+    int l, x, n, w, thr, s, k;
+
+    n = 3 * lg->sizeX;
+    w = lg->trans.weight;
+    switch (lg->trans.effect) {
+        case TRANSITION_FADE:
+            src1 = LedGrid_ImageRow (lg, lg->trans.from, y, lg->tmp[0]);
+            src2 = LedGrid_ImageRow (lg, lg->trans.to, y, lg->tmp[1]);
+            for (l=0; l<n; l++) {
+                row[l] = src1[l] + (((src2[l] - src1[l]) * w) >> 8);
+            }
+            break;
+
+        case TRANSITION_SLIDE_LEFT:
+        case TRANSITION_SLIDE_RIGHT:
+            src1 = LedGrid_ImageRow (lg, lg->trans.from, y, lg->tmp[0]);
+            src2 = LedGrid_ImageRow (lg, lg->trans.to, y, lg->tmp[1]);
+            s = (w * lg->sizeX) >> 8;
+            if (lg->trans.effect == TRANSITION_SLIDE_LEFT) {
+                memcpy (row, src1 + 3*s, 3*(lg->sizeX-s));
+                memcpy (row + 3*(lg->sizeX-s), src2, 3*s);
+            } else {
+                memcpy (row, src2 + 3*(lg->sizeX-s), 3*s);
+                memcpy (row + 3*s, src1, 3*(lg->sizeX-s));
+            }
+            break;
+
+        case TRANSITION_SLIDE_UP:
+        case TRANSITION_SLIDE_DOWN:
+            s = (w * lg->sizeY) >> 8;
+            if (lg->trans.effect == TRANSITION_SLIDE_UP) {
+                k = y + s;
+            } else {
+                k = y - s;
+            }
+            if ((k >= 0) && (k < lg->sizeY)) {
+                LedGrid_CopyRow (lg, lg->trans.from, k, row);
+            } else if (k < 0) {
+                LedGrid_CopyRow (lg, lg->trans.to, k+lg->sizeY, row);
+            } else {
+                LedGrid_CopyRow (lg, lg->trans.to, k-lg->sizeY, row);
+            }
+            break;
+
+        default:
+            src1 = LedGrid_ImageRow (lg, lg->trans.from, y, lg->tmp[0]);
+            src2 = LedGrid_ImageRow (lg, lg->trans.to, y, lg->tmp[1]);
+            mask = lg->mask[lg->trans.effect] + y * lg->sizeX;
+            thr  = w << 8;
+            for (x=0; x<lg->sizeX; x++) {
+                row[3*x+0] = (mask[x] < thr) ? src2[3*x+0] : src1[3*x+0];
+                row[3*x+1] = (mask[x] < thr) ? src2[3*x+1] : src1[3*x+1];
+                row[3*x+2] = (mask[x] < thr) ? src2[3*x+2] : src1[3*x+2];
+            }
+            break;
+    }
+}
+
+//
+// Berechnet die Zeile 'y' des Hintergrundes, d.h. des aktuellen Bildes
+// (ggf. ueberblendet mit dem naechsten Bild oder im Uebergang zwischen
+// zwei Bildern).
+//
+static void LedGrid_BaseRow (LedGrid lg, int y, unsigned char *row) {
+    unsigned char *src1, *src2;
+    int l, n;
+
+    n = 3 * lg->sizeX;
+    if (lg->trans.active) {
+        LedGrid_TransitionRow (lg, y, row);
+        return;
+    }
+    if (lg->fadeStep == 0) {
+        LedGrid_CopyRow (lg, lg->curImage, y, row);
+        return;
+    }
+    src1 = LedGrid_ImageRow (lg, lg->curImage, y, lg->tmp[0]);
+    src2 = LedGrid_ImageRow (lg, LedGrid_NextFrame (lg, lg->curImage, 1), y,
+            lg->tmp[1]);
+    for (l=0; l<n; l++) {
+        row[l] = src1[l] + lg->fadeStep * (src2[l]-src1[l]) / 100;
+    }
+}
+
+//
+// Mischt die Zeile 'y' der Ebene 'ly' in 'row'. Der Mischmodus wird
+// ausserhalb der inneren Schleife ausgewertet, so dass jede Schleife nur
+// aus Integer-Arithmetik ohne Verzweigungen besteht.
+//
+static void LedGrid_BlendRow (LedGrid lg, LedLayer *ly, int y,
+        unsigned char *row) {
+    unsigned char *src;
+    int l, n, a, b, v, r;
+
+    n   = 3 * lg->sizeX;
+    a   = ly->alpha;
+    src = LedGrid_ImageRow (lg, ly->image, y, lg->tmp[0]);
+    switch (ly->mode) {
+        case BLEND_NORMAL:
+            for (l=0; l<n; l++) {
+                b = row[l];
+                row[l] = b + (((src[l] - b) * a) >> 8);
+            }
+            break;
+        case BLEND_ADD:
+            for (l=0; l<n; l++) {
+                b = row[l];
+                v = b + src[l];
+                r = (v > 255) ? 255 : v;
+                row[l] = b + (((r - b) * a) >> 8);
+            }
+            break;
+        case BLEND_MULTIPLY:
+            for (l=0; l<n; l++) {
+                b = row[l];
+                v = b * src[l] + 128;
+                r = (v + (v >> 8)) >> 8;
+                row[l] = b + (((r - b) * a) >> 8);
+            }
+            break;
+        case BLEND_SCREEN:
+            for (l=0; l<n; l++) {
+                b = row[l];
+                v = (255 - b) * (255 - src[l]) + 128;
+                r = 255 - ((v + (v >> 8)) >> 8);
+                row[l] = b + (((r - b) * a) >> 8);
+            }
+            break;
+        case BLEND_MAX:
+            for (l=0; l<n; l++) {
+                b = row[l];
+                r = (src[l] > b) ? src[l] : b;
+                row[l] = b + (((r - b) * a) >> 8);
+            }
+            break;
+    }
+}
+
+//
+// Kopiert die fertige Zeile 'y' in den Ausgabepuffer. Ungerade Zeilen
+// laufen auf dem Strip in umgekehrter Richtung. Der Strip des Grids wird
+// nie rotiert, sein Ringpuffer beginnt also immer bei 0.
+//
+static void LedGrid_PutRow (LedGrid lg, int y, unsigned char *row,
+        unsigned char *out) {
+    int x, n;
+
+    n = 3 * lg->sizeX;
+    out += lg->startByte + y * n;
+    if (y%2 == 0) {
+        memcpy (out, row, n);
+    } else {
+        for (x=lg->sizeX-1; x>=0; x--) {
+            *out++ = row[3*x+0];
+            *out++ = row[3*x+1];
+            *out++ = row[3*x+2];
+        }
+    }
+}
+
+void LedGrid_Show (LedGrid lg) {
+    unsigned char *out;
+    int y, i;
+
+    assert (lg != NULL);
+
+    Semaphore_P (lg->sem);
+#ifdef LEDGRID_V1
+    out = lg->array;
+#endif
+#ifdef LEDGRID_V2
+    out = lg->ls->array;
+#endif
+    LedGrid_UpdateTransition (lg);
+    for (y=0; y<lg->sizeY; y++) {
+        LedGrid_BaseRow (lg, y, lg->row);
+        for (i=0; i<lg->numLayers; i++) {
+            if (lg->layer[i].visible && (lg->layer[i].alpha > 0)) {
+                LedGrid_BlendRow (lg, &lg->layer[i], y, lg->row);
+            }
+        }
+        LedGrid_PutRow (lg, y, lg->row, out);
+    }
+#ifdef LEDGRID_V1
+    write (lg->fd, lg->array, 3 * LEDSTRIP_MAXLENGTH);
+    fsync (lg->fd);
+#endif
+#ifdef LEDGRID_V2
+    LedStrip_Show (lg->ls);
+#endif
+    Semaphore_V (lg->sem);
+}
+
+void LedGrid_SetGamma (LedGrid lg, float gammaValue) {
+    assert (lg != NULL);
+
+    LedStrip_SetGamma (lg->ls, gammaValue);
+}
+
+//
+// Wie 'LedStrip_LoadCalibration', die LED's werden hier jedoch ueber ihre
+// Koordinaten angegeben (z.B. "3 7 1.00 0.92 0.85").
+//
+int LedGrid_LoadCalibration (LedGrid lg, char *fileName) {
+    FILE *fd;
+    int x, y, pixel;
+    float red, green, blue;
+
+    assert (lg != NULL);
+    assert (fileName != NULL);
+
+    fd = fopen (fileName, "r");
+    if (fd == NULL) {
+        return -1;
+    }
+    while (fscanf (fd, "%d %d %f %f %f", &x, &y, &red, &green, &blue) == 5) {
+        if ((x < 0) || (x >= lg->sizeX) || (y < 0) || (y >= lg->sizeY)) {
+            continue;
+        }
+        pixel = lg->startByte / 3 + y * lg->sizeX;
+        pixel += (y%2 == 0) ? x : lg->sizeX-1-x;
+        LedStrip_SetCalibration (lg->ls, pixel, red, green, blue);
+    }
+    fclose (fd);
+
+    return 0;
+}
+
+void LedGrid_ClearCalibration (LedGrid lg) {
+    assert (lg != NULL);
+
+    LedStrip_ClearCalibration (lg->ls);
+}
+
+void LedGrid_SetColor (LedGrid lg, int x, int y, unsigned char red,
+        unsigned char green, unsigned char blue) {
+    LedGrid_SetColorValue (lg, x, y, RED, red);
+    LedGrid_SetColorValue (lg, x, y, GREEN, green);
+    LedGrid_SetColorValue (lg, x, y, BLUE, blue);
+}
+
+void LedGrid_SetColorValue (LedGrid lg, int x, int y,
+        enum LedStrip_ColorIndexEnum colorIndex, unsigned char value) {
+    assert (lg != NULL);
+    assert ((x >= 0) && (y >= 0));
+    assert ((colorIndex >= RED) && (colorIndex <= BLUE));
+    assert ((value >= 0) && (value < 256));
+
+    LedGrid_Pixel (lg, LEDGRID_DRAWIMAGE(lg), x, y)[colorIndex] = value;
+}
+
+void LedGrid_SetValue (LedGrid lg, int x, int y, unsigned char value) {
+    LedGrid_SetColor (lg, x, y, value, value, value);
+}
+
+void LedGrid_SetRed (LedGrid lg, int x, int y, unsigned char value) {
+    LedGrid_SetColorValue (lg, x, y, RED, value);
+}
+
+void LedGrid_SetGreen (LedGrid lg, int x, int y, unsigned char value) {
+    LedGrid_SetColorValue (lg, x, y, GREEN, value);
+}
+
+void LedGrid_SetBlue (LedGrid lg, int x, int y, unsigned char value) {
+    LedGrid_SetColorValue (lg, x, y, BLUE, value);
 }
 
 void LedGrid_SetColorInt (LedGrid lg, int x, int y, unsigned int value) {
@@ -706,33 +1705,35 @@ void LedGrid_SetColorInt (LedGrid lg, int x, int y, unsigned int value) {
 
 void LedGrid_SetAllColor (LedGrid lg, unsigned char red,
         unsigned char green, unsigned char blue) {
-    int x, y;
+    int img, x, y;
 
     assert (lg != NULL);
     assert ((red >= 0) && (red < 256));
     assert ((green >= 0) && (green < 256));
     assert ((blue >= 0) && (blue < 256));
 
-    for (y=0; y<lg->sizeY; y++) {
-        for (x=0; x<lg->sizeX; x++) {
-            lg->field[lg->curImage][y][3 * x + RED]   = red;
-            lg->field[lg->curImage][y][3 * x + GREEN] = green;
-            lg->field[lg->curImage][y][3 * x + BLUE]  = blue;
+    img = LEDGRID_DRAWIMAGE(lg);
+    for (y=0; y<lg->image[img].sizeY; y++) {
+        for (x=0; x<lg->image[img].sizeX; x++) {
+            lg->field[img][y][3 * x + RED]   = red;
+            lg->field[img][y][3 * x + GREEN] = green;
+            lg->field[img][y][3 * x + BLUE]  = blue;
         }
     }
 }
 
 void LedGrid_SetAllColorValue (LedGrid lg,
         enum LedStrip_ColorIndexEnum colorIndex, unsigned char value) {
-    int x, y;
+    int img, x, y;
 
     assert (lg != NULL);
     assert ((colorIndex >= RED) && (colorIndex <= BLUE));
     assert ((value >= 0) && (value < 256));
 
-    for (y=0; y<lg->sizeY; y++) {
-        for (x=0; x<lg->sizeX; x++) {
-            lg->field[lg->curImage][y][3 * x + colorIndex] = value;
+    img = LEDGRID_DRAWIMAGE(lg);
+    for (y=0; y<lg->image[img].sizeY; y++) {
+        for (x=0; x<lg->image[img].sizeX; x++) {
+            lg->field[img][y][3 * x + colorIndex] = value;
         }
     }
 }
@@ -741,7 +1742,7 @@ unsigned char LedGrid_GetValue (LedGrid lg, int x, int y) {
     assert (lg != NULL);
     assert ((x >= 0) && (y >= 0));
 
-    return lg->field[lg->curImage][y][3 * x];
+    return LedGrid_Pixel (lg, LEDGRID_DRAWIMAGE(lg), x, y)[0];
 }
 
 unsigned char LedGrid_GetColorValue (LedGrid lg, int x, int y,
@@ -750,28 +1751,28 @@ unsigned char LedGrid_GetColorValue (LedGrid lg, int x, int y,
     assert ((x >= 0) && (y >= 0));
     assert ((colorIndex >= RED) && (colorIndex <= BLUE));
 
-    return lg->field[lg->curImage][y][3 * x + colorIndex];
+    return LedGrid_Pixel (lg, LEDGRID_DRAWIMAGE(lg), x, y)[colorIndex];
 }
 
 unsigned char LedGrid_GetRed (LedGrid lg, int x, int y) {
     assert (lg != NULL);
     assert ((x >= 0) && (y >= 0));
 
-    return lg->field[lg->curImage][y][3 * x + RED];
+    return LedGrid_Pixel (lg, LEDGRID_DRAWIMAGE(lg), x, y)[RED];
 }
 
 unsigned char LedGrid_GetGreen (LedGrid lg, int x, int y) {
     assert (lg != NULL);
     assert ((x >= 0) && (y >= 0));
 
-    return lg->field[lg->curImage][y][3 * x + GREEN];
+    return LedGrid_Pixel (lg, LEDGRID_DRAWIMAGE(lg), x, y)[GREEN];
 }
 
 unsigned char LedGrid_GetBlue (LedGrid lg, int x, int y) {
     assert (lg != NULL);
     assert ((x >= 0) && (y >= 0));
 
-    return lg->field[lg->curImage][y][3 * x + BLUE];
+    return LedGrid_Pixel (lg, LEDGRID_DRAWIMAGE(lg), x, y)[BLUE];
 }
 
 void LedGrid_AllOn (LedGrid lg) {
@@ -801,56 +1802,150 @@ void LedGrid_AllOff (LedGrid lg) {
 }
 
 int LedGrid_NewImage (LedGrid lg) {
-    int i, imgIndex;
+    int imgIndex;
 
     assert (lg != NULL);
 
     imgIndex = lg->numImages;
     lg->numImages += 1;
     lg->field = realloc (lg->field, lg->numImages * sizeof (unsigned char **));
-    lg->field[imgIndex] = calloc (lg->sizeY, sizeof (unsigned char *));
-    for (i=0; i<lg->sizeY; i++) {
-        lg->field[imgIndex][i] = calloc (lg->sizeX, 3 * sizeof (unsigned char));
-    }
+    lg->image = realloc (lg->image, lg->numImages * sizeof (LedImage));
+    LedGrid_AllocImage (lg, imgIndex, lg->sizeX, lg->sizeY);
+
+    return imgIndex;
+}
+
+//
+// Erzeugt ein neues Bild, welches groesser als das Panel sein kann. Der
+// angezeigte Ausschnitt wird mit 'LedGrid_SetViewport' gewaehlt.
+//
+int LedGrid_NewCanvas (LedGrid lg, int sizeX, int sizeY) {
+    int imgIndex;
+
+    assert (lg != NULL);
+    assert ((sizeX >= lg->sizeX) && (sizeY >= lg->sizeY));
+
+    imgIndex = lg->numImages;
+    lg->numImages += 1;
+    lg->field = realloc (lg->field, lg->numImages * sizeof (unsigned char **));
+    lg->image = realloc (lg->image, lg->numImages * sizeof (LedImage));
+    LedGrid_AllocImage (lg, imgIndex, sizeX, sizeY);
 
     return imgIndex;
 }
 
+//
+// Aendert die Breite eines Bildes; der Inhalt links bleibt erhalten, neue
+// Spalten sind schwarz. Das Bild muss normalisiert sein (Ursprung 0,0).
+//
+static void LedGrid_ResizeImage (LedGrid lg, int img, int sizeX) {
+    LedImage *im;
+    int y;
+
+    im = &lg->image[img];
+    assert ((im->originX == 0) && (im->originY == 0));
+    for (y=0; y<im->sizeY; y++) {
+        lg->field[img][y] = realloc (lg->field[img][y], 3 * sizeX);
+        if (sizeX > im->sizeX) {
+            memset (lg->field[img][y] + 3*im->sizeX, 0,
+                    3 * (sizeX - im->sizeX));
+        }
+    }
+    im->sizeX = sizeX;
+    im->viewX = im->viewX % sizeX;
+}
+
+//
+// Setzt den angezeigten Ausschnitt des Bildes, in welches gezeichnet wird
+// (siehe 'LedGrid_SetDrawImage'). Der Ausschnitt wird an den Raendern des
+// Bildes umgebrochen.
+//
+void LedGrid_SetViewport (LedGrid lg, int x, int y) {
+    LedImage *im;
+
+    assert (lg != NULL);
+
+    im = &lg->image[LEDGRID_DRAWIMAGE(lg)];
+    x %= im->sizeX;
+    y %= im->sizeY;
+    im->viewX = (x < 0) ? x + im->sizeX : x;
+    im->viewY = (y < 0) ? y + im->sizeY : y;
+}
+
+void LedGrid_MoveViewport (LedGrid lg, int dx, int dy) {
+    LedImage *im;
+
+    assert (lg != NULL);
+
+    im = &lg->image[LEDGRID_DRAWIMAGE(lg)];
+    LedGrid_SetViewport (lg, im->viewX + dx, im->viewY + dy);
+}
+
+//
+// Liest ein Bild im Format von 'LedGrid_SaveImage'. Passt die Groesse
+// nicht zum Bild 'imgIndex', wird es mit einem Box-Filter so skaliert,
+// dass es das Bild fuellt (ueberstehende Raender werden abgeschnitten).
+//
 int LedGrid_LoadImage (LedGrid lg, char *fileName, int imgIndex) {
     FILE *fd;
+    Resampler rs;
+    unsigned char *buf;
     int sizeX, sizeY;
-    int x, y, red, green, blue;
+    int i, y, red, green, blue;
+    LedImage *im;
 
     assert (lg != NULL);
     assert (fileName != NULL);
 
-    if (imgIndex < 0) {
-        imgIndex = LedGrid_NewImage (lg);
-    } else if (imgIndex >= lg->numImages) {
+    if (imgIndex >= lg->numImages) {
         return -1;
     }
 
     fd = fopen (fileName, "r");
-    fscanf (fd, "%d %d", &sizeX, &sizeY);
-    if ((sizeX != lg->sizeX) || (sizeY != lg->sizeY)) {
+    if (fd == NULL) {
         return -1;
     }
-    for (y=0; y<lg->sizeY; y++) {
-        for (x=0; x<lg->sizeX; x++) {
-            fscanf (fd, "%2x%2x%2x", &red, &green, &blue);
-            lg->field[imgIndex][y][3 * x + RED] = red;
-            lg->field[imgIndex][y][3 * x + GREEN] = green;
-            lg->field[imgIndex][y][3 * x + BLUE] = blue;
+    if ((fscanf (fd, "%d %d", &sizeX, &sizeY) != 2)
+            || (sizeX <= 0) || (sizeY <= 0)) {
+        fclose (fd);
+        return -1;
+    }
+    buf = calloc (sizeX * sizeY, 3 * sizeof (unsigned char));
+    for (i=0; i<sizeX*sizeY; i++) {
+        if (fscanf (fd, "%2x%2x%2x", &red, &green, &blue) != 3) {
+            break;
         }
+        buf[3 * i + RED]   = red;
+        buf[3 * i + GREEN] = green;
+        buf[3 * i + BLUE]  = blue;
     }
     fclose (fd);
 
+    if (imgIndex < 0) {
+        imgIndex = LedGrid_NewImage (lg);
+    }
+    im = &lg->image[imgIndex];
+    im->originX = 0;
+    im->originY = 0;
+    if ((sizeX == im->sizeX) && (sizeY == im->sizeY)) {
+        for (y=0; y<sizeY; y++) {
+            memcpy (lg->field[imgIndex][y], buf + 3 * y * sizeX, 3 * sizeX);
+        }
+    } else {
+        rs = Resampler_Init (sizeX, sizeY, im->sizeX, im->sizeY,
+                RESAMPLER_BOX, RESAMPLER_FILL);
+        LedGrid_DrawResampled (lg, rs, buf, 3 * sizeX, imgIndex);
+        Resampler_Free (rs);
+    }
+    free (buf);
+
     return imgIndex;
 }
 
 int LedGrid_SaveImage (LedGrid lg, char *fileName, int imgIndex) {
     FILE *fd;
-    int x, y, red, green, blue;
+    unsigned char *pix;
+    int x, y;
 
     assert (lg != NULL);
     assert (fileName != NULL);
@@ -862,13 +1957,12 @@ int LedGrid_SaveImage (LedGrid lg, char *fileName, int imgIndex) {
     }
 
     fd = fopen (fileName, "w");
-    fprintf (fd, "%d %d\n\n", lg->sizeX, lg->sizeY);
-    for (y=0; y<lg->sizeY; y++) {
-        for (x=0; x<lg->sizeX; x++) {
-            red = LedGrid_GetRed (lg, x, y);
-            green = LedGrid_GetGreen (lg, x, y);
-            blue = LedGrid_GetBlue (lg, x, y);
-            fprintf (fd, "%02x%02x%02x ", red, green, blue);
+    fprintf (fd, "%d %d\n\n", lg->image[imgIndex].sizeX,
+            lg->image[imgIndex].sizeY);
+    for (y=0; y<lg->image[imgIndex].sizeY; y++) {
+        for (x=0; x<lg->image[imgIndex].sizeX; x++) {
+            pix = LedGrid_Pixel (lg, imgIndex, x, y);
+            fprintf (fd, "%02x%02x%02x ", pix[RED], pix[GREEN], pix[BLUE]);
         }
         fprintf (fd, "\n");
     }
@@ -884,64 +1978,388 @@ void LedGrid_SetImage (LedGrid lg, int imgIndex, int fadeStep) {
     if (imgIndex >= lg->numImages) {
         return;
     }
+    assert (! lg->image[imgIndex].isLayer);
     Semaphore_P (lg->sem);
+    lg->trans.active = 0;
     lg->curImage = imgIndex;
     lg->fadeStep = fadeStep;
     Semaphore_V (lg->sem);
 }
 
-int LedGrid_GetImageCount (LedGrid lg) {
+//
+// Startet einen Uebergang von Bild 'from' nach Bild 'to' mit einer Dauer
+// von 'duration' Millisekunden. Der Uebergang wird von 'LedGrid_Show'
+// anhand der Zeit berechnet und ist damit unabhaengig von der Bildrate.
+// Nach Ablauf ist 'to' das aktuelle Bild.
+//
+void LedGrid_Transition (LedGrid lg, int from, int to, int duration,
+        enum LedGrid_EasingEnum easing) {
+    LedGrid_TransitionEffect (lg, from, to, duration, easing,
+            TRANSITION_FADE);
+}
+
+//
+// Wie 'LedGrid_Transition', jedoch mit einem anderen Effekt als der
+// Ueberblendung (Wipe, Iris, Dissolve oder Slide).
+//
+void LedGrid_TransitionEffect (LedGrid lg, int from, int to, int duration,
+        enum LedGrid_EasingEnum easing, enum LedGrid_TransitionEnum effect) {
     assert (lg != NULL);
+    assert ((from >= 0) && (from < lg->numImages));
+    assert ((to >= 0) && (to < lg->numImages));
+    assert (! lg->image[from].isLayer && ! lg->image[to].isLayer);
+    assert ((easing >= EASE_LINEAR) && (easing <= EASE_IN_OUT));
+    assert ((effect >= TRANSITION_FADE) && (effect <= TRANSITION_SLIDE_DOWN));
+
+    if ((effect > TRANSITION_FADE) && (effect < TRANSITION_SLIDE_LEFT)) {
+        LedGrid_GetMask (lg, effect);
+    }
 
-    return lg->numImages;
+    Semaphore_P (lg->sem);
+    if (duration <= 0) {
+        lg->trans.active = 0;
+        lg->curImage = to;
+        lg->fadeStep = 0;
+    } else {
+        lg->trans.from     = from;
+        lg->trans.to       = to;
+        lg->trans.duration = duration;
+        lg->trans.easing   = easing;
+        lg->trans.effect   = effect;
+        lg->trans.weight   = 0;
+        clock_gettime (CLOCK_MONOTONIC, &lg->trans.start);
+        lg->trans.active   = 1;
+    }
+    Semaphore_V (lg->sem);
 }
 
-int LedGrid_GetCurImage (LedGrid lg) {
+int LedGrid_InTransition (LedGrid lg) {
     assert (lg != NULL);
 
-    return lg->curImage;
+    return lg->trans.active;
 }
 
-void LedGrid_FadeImage (LedGrid lg) {
-    int curIndex, newIndex;
-    int x, y, i, j, k;
-    int value;
+//
+// Liefert die Anzahl Einzelbilder; die Bilder der Ebenen werden nicht
+// mitgezaehlt.
+//
+int LedGrid_GetImageCount (LedGrid lg) {
+    int i, count;
 
     assert (lg != NULL);
 
-    curIndex = lg->curImage;
-    newIndex = curIndex + 1;
-    if (newIndex == lg->numImages) {
-        LedGrid_NewImage (lg);
-    }
-
-    for (y=0; y<lg->sizeY; y++) {
-        for (x=0; x<lg->sizeX; x++) {
-            for (k=0; k<3; k++) {
-                value = 0;
-                for (i=y-1; i<=y+1; i++) {
-                    for (j=x-1; j<=x+1; j++) {
-                        if ((i<0) || (i>=lg->sizeY) || (j<0) \
-                                || (j>=lg->sizeX) || ((i==y) && (j==x))) {
-                            continue;
-                        }
-                        value += lg->field[curIndex][i][3*j+k];
-                    }
-                }
-                value = value / 8;
-                value += lg->field[curIndex][y][3*x+k];
-                value = value / 2;
-                lg->field[newIndex][y][3*x+k] = value;
-            }
+    count = 0;
+    for (i=0; i<lg->numImages; i++) {
+        if (! lg->image[i].isLayer) {
+            count++;
         }
     }
+    return count;
 }
 
-/*
-void LedGrid_InterpolateImage (LedGrid lg) {
-    int curIndex;
+int LedGrid_GetCurImage (LedGrid lg) {
+    assert (lg != NULL);
 
-    curIndex = lg->curImage;
+    return lg->curImage;
+}
+
+void LedGrid_SetDrawImage (LedGrid lg, int imgIndex) {
+    assert (lg != NULL);
+    assert (imgIndex < lg->numImages);
+
+    lg->drawImage = imgIndex;
+}
+
+int LedGrid_GetDrawImage (LedGrid lg) {
+    assert (lg != NULL);
+
+    return LEDGRID_DRAWIMAGE(lg);
+}
+
+//
+// Ebenen werden beim Anzeigen in der Reihenfolge ihrer Erzeugung ueber das
+// aktuelle Bild gelegt. Jede Ebene besitzt ein eigenes Bild, in welches
+// mit 'LedGrid_SetDrawImage (lg, LedGrid_GetLayerImage (lg, layer))'
+// gezeichnet werden kann.
+//
+int LedGrid_NewLayer (LedGrid lg, enum LedGrid_BlendModeEnum mode) {
+    int layerIndex, imgIndex;
+
+    assert (lg != NULL);
+    assert ((mode >= BLEND_NORMAL) && (mode <= BLEND_MAX));
+
+    imgIndex = LedGrid_NewImage (lg);
+
+    Semaphore_P (lg->sem);
+    layerIndex = lg->numLayers;
+    lg->numLayers += 1;
+    lg->layer = realloc (lg->layer, lg->numLayers * sizeof (LedLayer));
+    lg->layer[layerIndex].image   = imgIndex;
+    lg->layer[layerIndex].alpha   = 256;
+    lg->layer[layerIndex].mode    = mode;
+    lg->layer[layerIndex].visible = 1;
+    lg->image[imgIndex].isLayer   = 1;
+    Semaphore_V (lg->sem);
+
+    return layerIndex;
+}
+
+int LedGrid_GetLayerCount (LedGrid lg) {
+    assert (lg != NULL);
+
+    return lg->numLayers;
+}
+
+int LedGrid_GetLayerImage (LedGrid lg, int layer) {
+    assert (lg != NULL);
+    assert ((layer >= 0) && (layer < lg->numLayers));
+
+    return lg->layer[layer].image;
+}
+
+void LedGrid_SetLayerOpacity (LedGrid lg, int layer, unsigned char opacity) {
+    assert (lg != NULL);
+    assert ((layer >= 0) && (layer < lg->numLayers));
+
+    lg->layer[layer].alpha = opacity + (opacity >> 7);
+}
+
+unsigned char LedGrid_GetLayerOpacity (LedGrid lg, int layer) {
+    assert (lg != NULL);
+    assert ((layer >= 0) && (layer < lg->numLayers));
+
+    return (lg->layer[layer].alpha > 128) ? lg->layer[layer].alpha - 1
+            : lg->layer[layer].alpha;
+}
+
+void LedGrid_SetLayerMode (LedGrid lg, int layer,
+        enum LedGrid_BlendModeEnum mode) {
+    assert (lg != NULL);
+    assert ((layer >= 0) && (layer < lg->numLayers));
+    assert ((mode >= BLEND_NORMAL) && (mode <= BLEND_MAX));
+
+    lg->layer[layer].mode = mode;
+}
+
+void LedGrid_SetLayerVisible (LedGrid lg, int layer, int visible) {
+    assert (lg != NULL);
+    assert ((layer >= 0) && (layer < lg->numLayers));
+
+    lg->layer[layer].visible = visible;
+}
+
+//
+// Stellt sicher, dass die Zwischenpuffer fuer das Weichzeichnen gross
+// genug fuer ein Bild von sizeX x sizeY Pixeln sind. Die Puffer wachsen
+// nur, im Normalfall wird also waehrend einer Animation nichts alloziert.
+//
+static void LedGrid_BlurAlloc (LedGrid lg, int sizeX, int sizeY) {
+    int width;
+
+    if (sizeX * sizeY > lg->blurSize) {
+        lg->blurSize = sizeX * sizeY;
+        free (lg->blurMid);
+        lg->blurMid = calloc (lg->blurSize, 3 * sizeof (unsigned short));
+    }
+    width = sizeX + 2 * lg->blurRadius + 2;
+    if (width > lg->blurWidth) {
+        lg->blurWidth = width;
+        free (lg->blurPad);
+        free (lg->blurAcc);
+        lg->blurPad = calloc (lg->blurWidth, 3 * sizeof (unsigned short));
+        lg->blurAcc = calloc (lg->blurWidth, 3 * sizeof (int));
+    }
+}
+
+//
+// Legt Art und Radius des Weichzeichners fest. Die Gewichte des (separier-
+// baren) Kerns werden hier einmal berechnet; sie sind Festkommazahlen mit
+// Summe 256. Die Gewichte werden abgerundet und der Rest einzeln auf die
+// Stellen mit den groessten Rundungsfehlern verteilt (bei gleichen Fehlern
+// zuerst nahe der Mitte), damit kein Gewicht negativ wird. Der Radius ist
+// auf LEDGRID_BLUR_MAXRADIUS beschraenkt, damit beim Box-Filter jede
+// Stelle mindestens das Gewicht 1 erhaelt.
+//
+#define LEDGRID_BLUR_MAXRADIUS 127
+
+void LedGrid_SetBlur (LedGrid lg, enum LedGrid_BlurEnum type, int radius) {
+    double *w, sum, sigma, best;
+    int i, k, total;
+
+    assert (lg != NULL);
+    assert ((type == BLUR_BOX) || (type == BLUR_GAUSS));
+    assert ((radius >= 0) && (radius <= LEDGRID_BLUR_MAXRADIUS));
+
+    w = calloc (2*radius+1, sizeof (double));
+    sigma = (radius > 0) ? radius / 2.0 : 1.0;
+    sum = 0.0;
+    for (i=-radius; i<=radius; i++) {
+        if (type == BLUR_BOX) {
+            w[i+radius] = 1.0;
+        } else {
+            w[i+radius] = exp (-(i*i) / (2.0*sigma*sigma));
+        }
+        sum += w[i+radius];
+    }
+
+    free (lg->blurKernel);
+    lg->blurKernel = calloc (2*radius+1, sizeof (int));
+    total = 0;
+    for (i=0; i<2*radius+1; i++) {
+        w[i] = 256.0 * w[i] / sum;
+        lg->blurKernel[i] = (int) w[i];
+        w[i] -= lg->blurKernel[i];
+        total += lg->blurKernel[i];
+    }
+    for (; total<256; total++) {
+        k = radius;
+        best = w[radius];
+        for (i=0; i<2*radius+1; i++) {
+            if ((w[i] > best) || ((w[i] == best)
+                    && (abs (i-radius) < abs (k-radius)))) {
+                k = i;
+                best = w[i];
+            }
+        }
+        lg->blurKernel[k]++;
+        w[k] = -1.0;
+    }
+    free (w);
+
+    lg->blurType   = type;
+    lg->blurRadius = radius;
+    LedGrid_BlurAlloc (lg, lg->sizeX, lg->sizeY);
+}
+
+//
+// Gemeinsamer Kern von 'LedGrid_BlurImage' und 'LedGrid_FadeImage'.
+// Zeilen- und Spaltendurchgang arbeiten mit Festkomma-Arithmetik auf ganzen
+// Zeilen. Das Quellbild wird ueber seinen Ursprung gelesen (die Pixeldaten
+// werden also nicht umgeschrieben); die Raender werden mit 'edge' durch
+// Wiederholen der Randpixel, sonst mit Schwarz aufgefuellt, so dass in den
+// inneren Schleifen keine Bereichspruefungen noetig sind. Da der
+// Zeilendurchgang vollstaendig in 'blurMid' landet, duerfen 'srcImg' und
+// 'dstImg' identisch sein.
+//
+static void LedGrid_Blur (LedGrid lg, int srcImg, int dstImg, int edge) {
+    unsigned char *src, *dst;
+    unsigned short *pad, *mid, *m;
+    int *acc, *kernel;
+    int sizeX, sizeY, ox, oy, r, n, x, y, yy, i, l, w;
+
+    sizeX = lg->image[srcImg].sizeX;
+    sizeY = lg->image[srcImg].sizeY;
+    ox    = lg->image[srcImg].originX;
+    oy    = lg->image[srcImg].originY;
+    LedGrid_BlurAlloc (lg, sizeX, sizeY);
+
+    r      = lg->blurRadius;
+    kernel = lg->blurKernel;
+    n      = 3 * sizeX;
+    pad    = lg->blurPad;
+    mid    = lg->blurMid;
+    acc    = lg->blurAcc;
+
+    // Zeilendurchgang: Resultat mit 8 Nachkommabits in 'mid'.
+    if (! edge) {
+        memset (pad, 0, (n + 6*r) * sizeof (unsigned short));
+    }
+    for (y=0; y<sizeY; y++) {
+        src = lg->field[srcImg][(y + oy) % sizeY];
+        for (l=0; l<3*(sizeX-ox); l++) {
+            pad[3*r+l] = src[3*ox+l];
+        }
+        for (l=0; l<3*ox; l++) {
+            pad[3*(r+sizeX-ox)+l] = src[l];
+        }
+        if (edge) {
+            for (x=0; x<r; x++) {
+                pad[3*x+0] = pad[3*r+0];
+                pad[3*x+1] = pad[3*r+1];
+                pad[3*x+2] = pad[3*r+2];
+                pad[3*(r+sizeX+x)+0] = pad[3*(r+sizeX-1)+0];
+                pad[3*(r+sizeX+x)+1] = pad[3*(r+sizeX-1)+1];
+                pad[3*(r+sizeX+x)+2] = pad[3*(r+sizeX-1)+2];
+            }
+        }
+        memset (acc, 0, n * sizeof (int));
+        for (i=0; i<2*r+1; i++) {
+            w = kernel[i];
+            for (l=0; l<n; l++) {
+                acc[l] += w * pad[3*i+l];
+            }
+        }
+        m = mid + y * n;
+        for (l=0; l<n; l++) {
+            m[l] = acc[l];
+        }
+    }
+
+    // Spaltendurchgang: Zeilen ausserhalb des Bildes werden durch die
+    // Randzeilen ersetzt oder (ohne 'edge') weggelassen.
+    lg->image[dstImg].originX = 0;
+    lg->image[dstImg].originY = 0;
+    for (y=0; y<sizeY; y++) {
+        memset (acc, 0, n * sizeof (int));
+        for (i=-r; i<=r; i++) {
+            yy = y + i;
+            if ((yy < 0) || (yy >= sizeY)) {
+                if (! edge) {
+                    continue;
+                }
+                yy = (yy < 0) ? 0 : sizeY-1;
+            }
+            w = kernel[i+r];
+            m = mid + yy * n;
+            for (l=0; l<n; l++) {
+                acc[l] += w * m[l];
+            }
+        }
+        dst = lg->field[dstImg][y];
+        for (l=0; l<n; l++) {
+            dst[l] = (acc[l] + 32768) >> 16;
+        }
+    }
+}
+
+//
+// Zeichnet das Bild 'srcImg' weich und legt das Resultat in 'dstImg' ab
+// (beide duerfen identisch sein). Am Rand werden die Randpixel wiederholt.
+//
+void LedGrid_BlurImage (LedGrid lg, int srcImg, int dstImg) {
+    assert (lg != NULL);
+    assert ((srcImg >= 0) && (srcImg < lg->numImages));
+    assert ((dstImg >= 0) && (dstImg < lg->numImages));
+    assert (lg->image[srcImg].sizeX == lg->image[dstImg].sizeX);
+    assert (lg->image[srcImg].sizeY == lg->image[dstImg].sizeY);
+
+    LedGrid_Blur (lg, srcImg, dstImg, 1);
+}
+
+//
+// Wie 'LedGrid_BlurImage' (mit dem Kern aus 'LedGrid_SetBlur'), jedoch
+// zaehlen Pixel ausserhalb des Bildes als Schwarz; wiederholt aufgerufen
+// verlaufen Leuchtspuren so ins Dunkle. Das Zielbild wird vom Aufrufer
+// bereitgestellt (z.B. einmal mit 'LedGrid_NewImage' vor der Animation,
+// oder 'dstImg' gleich 'srcImg'); waehrend der Animation wird nichts
+// alloziert.
+//
+void LedGrid_FadeImage (LedGrid lg, int srcImg, int dstImg) {
+    assert (lg != NULL);
+    assert ((srcImg >= 0) && (srcImg < lg->numImages));
+    assert ((dstImg >= 0) && (dstImg < lg->numImages));
+    assert (! lg->image[srcImg].isLayer && ! lg->image[dstImg].isLayer);
+    assert (lg->image[srcImg].sizeX == lg->image[dstImg].sizeX);
+    assert (lg->image[srcImg].sizeY == lg->image[dstImg].sizeY);
+
+    LedGrid_Blur (lg, srcImg, dstImg, 0);
+}
+
+/*
+void LedGrid_InterpolateImage (LedGrid lg) {
+    int curIndex;
+
+    curIndex = lg->curImage;
 }
 */
 
@@ -951,9 +2369,9 @@ void LedGrid_Clear (LedGrid lg) {
 
     assert (lg != NULL);
 
-    curIndex = lg->curImage;
-    for (y=0; y<lg->sizeY; y++) {
-        for (x=0; x<lg->sizeX; x++) {
+    curIndex = LEDGRID_DRAWIMAGE(lg);
+    for (y=0; y<lg->image[curIndex].sizeY; y++) {
+        for (x=0; x<lg->image[curIndex].sizeX; x++) {
             for (k=0; k<3; k++) {
                 lg->field[curIndex][y][3*x+k] = 0;
             }
@@ -963,364 +2381,3156 @@ void LedGrid_Clear (LedGrid lg) {
 
 void LedGrid_Shift (LedGrid lg, enum LedGrid_ShiftDirectionEnum dir,
         int rotate) {
-    int i;
-    int x, y, k;
-    unsigned char t[3];
+    LedGrid_ShiftCount (lg, dir, 1, rotate);
+}
+
+//
+// Verschiebt das Bild um 'count' Pixel. Dazu wird nur der Ursprung des
+// Bildes verschoben; beim nicht-rotierenden Schieben werden zusaetzlich
+// die frei gewordenen Zeilen bzw. Spalten geloescht.
+//
+void LedGrid_ShiftCount (LedGrid lg, enum LedGrid_ShiftDirectionEnum dir,
+        int count, int rotate) {
+    LedImage *img;
+    int i, x, y, k, n;
 
     assert (lg != NULL);
+    assert (count >= 0);
 
-    i = lg->curImage;
+    i   = LEDGRID_DRAWIMAGE(lg);
+    img = &lg->image[i];
     switch (dir) {
         case SHIFT_UP:
-            for (x=0; x<lg->sizeX; x++) {
-                for (k=0; k<3; k++) {
-                    t[k] = lg->field[i][0][3*x+k];
-                    for (y=0; y<lg->sizeY-1; y++) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y+1][3*x+k];
-                    }
-                    if (rotate) {
-                        lg->field[i][y][3*x+k] = t[k];
-                    } else {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
-                }
-            }
-            break;
-
         case SHIFT_DOWN:
-            for (x=0; x<lg->sizeX; x++) {
-                for (k=0; k<3; k++) {
-                    t[k] = lg->field[i][lg->sizeY-1][3*x+k];
-                    for (y=lg->sizeY-1; y>0; y--) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y-1][3*x+k];
-                    }
-                    if (rotate) {
-                        lg->field[i][y][3*x+k] = t[k];
-                    } else {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
-                }
+            n = (count > img->sizeY) ? img->sizeY : count;
+            count %= img->sizeY;
+            if (dir == SHIFT_UP) {
+                img->originY = (img->originY + count) % img->sizeY;
+            } else {
+                img->originY = (img->originY - count + img->sizeY) % img->sizeY;
             }
-            break;
-
-        case SHIFT_LEFT:
-            for (y=0; y<lg->sizeY; y++) {
-                for (k=0; k<3; k++) {
-                    t[k] = lg->field[i][y][3*0+k];
-                    for (x=0; x<lg->sizeX-1; x++) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y][3*(x+1)+k];
-                    }
-                    if (rotate) {
-                        lg->field[i][y][3*x+k] = t[k];
-                    } else {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
+            if (! rotate) {
+                y = (dir == SHIFT_UP) ? img->sizeY-n : 0;
+                y = (y + img->originY) % img->sizeY;
+                for (k=0; k<n; k++) {
+                    memset (lg->field[i][y], 0, 3*img->sizeX);
+                    y = (y+1 == img->sizeY) ? 0 : y+1;
                 }
             }
             break;
 
+        case SHIFT_LEFT:
         case SHIFT_RIGHT:
-            for (y=0; y<lg->sizeY; y++) {
-                for (k=0; k<3; k++) {
-                    t[k] = lg->field[i][y][3*(lg->sizeX-1)+k];
-                    for (x=lg->sizeX-1; x>0; x--) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y][3*(x-1)+k];
-                    }
-                    if (rotate) {
-                        lg->field[i][y][3*x+k] = t[k];
+            n = (count > img->sizeX) ? img->sizeX : count;
+            count %= img->sizeX;
+            if (dir == SHIFT_LEFT) {
+                img->originX = (img->originX + count) % img->sizeX;
+            } else {
+                img->originX = (img->originX - count + img->sizeX) % img->sizeX;
+            }
+            if (! rotate) {
+                x = (dir == SHIFT_LEFT) ? img->sizeX-n : 0;
+                x = (x + img->originX) % img->sizeX;
+                for (y=0; y<img->sizeY; y++) {
+                    if (x + n <= img->sizeX) {
+                        memset (&lg->field[i][y][3*x], 0, 3*n);
                     } else {
-                        lg->field[i][y][3*x+k] = 0;
+                        memset (&lg->field[i][y][3*x], 0, 3*(img->sizeX-x));
+                        memset (lg->field[i][y], 0, 3*(x+n-img->sizeX));
                     }
                 }
             }
             break;
+    }
+}
+
+//
+// Liefert fuer das Pixel (x,y) einer Flaeche von sizeX x sizeY Pixeln das
+// entsprechende Pixel im Grundbereich der Symmetrie 'sym': bei Spiegelung
+// an der X- bzw. Y-Achse die linke bzw. obere Haelfte, bei SYMMETRY_QUAD
+// das linke obere Viertel und bei SYMMETRY_OCTANT davon die Haelfte
+// unterhalb der Diagonalen (y <= x).
+//
+static void LedGrid_SymmetrySource (enum LedGrid_SymmetryEnum sym,
+        int sizeX, int sizeY, int x, int y, int *sx, int *sy) {
+    int t;
 
+    if ((sym == SYMMETRY_MIRROR_X) || (sym >= SYMMETRY_QUAD)) {
+        x = (x < (sizeX+1)/2) ? x : sizeX-1-x;
+    }
+    if ((sym == SYMMETRY_MIRROR_Y) || (sym >= SYMMETRY_QUAD)) {
+        y = (y < (sizeY+1)/2) ? y : sizeY-1-y;
+    }
+    if ((sym == SYMMETRY_OCTANT) && (y > x)) {
+        t = x; x = y; y = t;
     }
+    *sx = x;
+    *sy = y;
 }
 
-/*
-void LedGrid_Shift (LedGrid lg, enum LedGrid_ShiftDirectionEnum dir,
-        int count, int rotate) {
-    int i;
-    int x, y, k;
+//
+// Fuer symmetrische Effekte: nur der Grundbereich des Bildes, in welches
+// gezeichnet wird, muss berechnet werden; diese Funktion kopiert ihn in
+// die restlichen Bereiche.
+//
+void LedGrid_Mirror (LedGrid lg, enum LedGrid_SymmetryEnum sym) {
+    LedImage *im;
+    int img, x, y, sx, sy;
 
     assert (lg != NULL);
 
-    i = lg->curImage;
-    switch (dir) {
-        case SHIFT_UP:
-            for (x=0; x<lg->sizeX; x++) {
-                for (y=0; y<lg->sizeY-count; y++) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y+count][3*x+k];
-                    }
-                }
-                for ( ; y<lg->sizeY; y++) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
-                }
-            }
-            break;
-        case SHIFT_DOWN:
-            for (x=0; x<lg->sizeX; x++) {
-                for (y=lg->sizeY-1; y>count; y--) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y-count][3*x+k];
-                    }
-                }
-                for ( ; y>=0; y--) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
-                }
-            }
-            break;
-        case SHIFT_LEFT:
-            for (y=0; y<lg->sizeY; y++) {
-                for (x=0; x<lg->sizeX-count; x++) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y][3*(x+count)+k];
-                    }
-                }
-                for ( ; x<lg->sizeX; x++) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
-                }
-            }
-            break;
-        case SHIFT_RIGHT:
-            for (y=0; y<lg->sizeY; y++) {
-                for (x=lg->sizeX-1; x>count; x--) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = lg->field[i][y][3*(x-count)+k];
-                    }
-                }
-                for ( ; x>=0; x--) {
-                    for (k=0; k<3; k++) {
-                        lg->field[i][y][3*x+k] = 0;
-                    }
-                }
+    img = LEDGRID_DRAWIMAGE(lg);
+    im  = &lg->image[img];
+    assert ((sym != SYMMETRY_OCTANT) || (im->sizeX == im->sizeY));
+
+    for (y=0; y<im->sizeY; y++) {
+        for (x=0; x<im->sizeX; x++) {
+            LedGrid_SymmetrySource (sym, im->sizeX, im->sizeY, x, y, &sx, &sy);
+            if ((sx != x) || (sy != y)) {
+                memcpy (LedGrid_Pixel (lg, img, x, y),
+                        LedGrid_Pixel (lg, img, sx, sy), 3);
             }
-            break;
+        }
     }
 }
-*/
 
 /*
- * ColorGrid --
+ * Sprite --
  */
 
-typedef struct ColorFuncType {
-    ColorFunc *func;
-    char *name;
-} ColorFuncType;
+//
+// Ein Sprite wird beim Erzeugen in eine Form gebracht, die sich ohne
+// Verzweigungen zeichnen laesst: 'color' enthaelt die Farbwerte (an
+// transparenten Stellen 0), 'mask' ist pro Byte 0xFF fuer transparente und
+// 0x00 fuer deckende Pixel. Gezeichnet wird dann mit
+// dst = (dst & mask) | color. Zeilen ohne transparente Pixel werden mit
+// memcpy kopiert, ganz transparente Zeilen uebersprungen.
+//
+enum Sprite_RowTypeEnum {
+    ROW_MIXED, ROW_OPAQUE, ROW_EMPTY
+};
 
-typedef struct ColorGrid {
-    LedGrid lg;
-    unsigned char **matrix;
-    // int **matrix;
-    int size;
-    int numFadeSteps;
-    int fadeStep[3], fadeIncr[3];
-    double maxValue[3], expValue[3];
-    int colorFunc[3];
-    int numColorFuncs;
-    ColorFuncType *colorFuncArray;
-    Semaphore sem;
-} *ColorGrid;
+struct Sprite {
+    int sizeX, sizeY;
+    unsigned char *color, *mask;
+    unsigned char *rowType;
+};
 
-ColorGrid ColorGrid_Init (int size, int numFadeSteps, float gammaValue) {
-    ColorGrid cg;
-    int i, j;
+Sprite Sprite_Init (int sizeX, int sizeY) {
+    Sprite sp;
 
-    assert ((size > 0) && (numFadeSteps > 0));
+    assert ((sizeX > 0) && (sizeY > 0));
 
-    cg = malloc (sizeof (* cg));
-    cg->lg = LedGrid_Init (size, size, gammaValue);
-    cg->matrix = calloc (3, sizeof (int *));
-    cg->size = size;
-    cg->numFadeSteps = numFadeSteps;
-    for (i=0; i<3; i++) {
-        cg->matrix[i] = calloc (2*(size-1)*numFadeSteps, sizeof (int));
-        for (j=0; j<2*(size-1)*numFadeSteps; j++) {
-            cg->matrix[i][j] = 0;
+    sp = malloc (sizeof (*sp));
+    sp->sizeX   = sizeX;
+    sp->sizeY   = sizeY;
+    sp->color   = calloc (sizeX * sizeY, 3 * sizeof (unsigned char));
+    sp->mask    = malloc (sizeX * sizeY * 3 * sizeof (unsigned char));
+    sp->rowType = malloc (sizeY * sizeof (unsigned char));
+    memset (sp->mask, 0xFF, sizeX * sizeY * 3);
+    memset (sp->rowType, ROW_EMPTY, sizeY);
+
+    return sp;
+}
+
+//
+// Liest ein Sprite aus einer Datei im Format von 'LedGrid_SaveImage'.
+// Pixel mit der Farbe 'keyColor' (0xRRGGBB) werden transparent.
+//
+Sprite Sprite_Load (char *fileName, unsigned int keyColor) {
+    Sprite sp;
+    FILE *fd;
+    int sizeX, sizeY;
+    int x, y;
+    unsigned int red, green, blue;
+
+    assert (fileName != NULL);
+
+    fd = fopen (fileName, "r");
+    if (fd == NULL) {
+        return NULL;
+    }
+    if ((fscanf (fd, "%d %d", &sizeX, &sizeY) != 2)
+            || (sizeX <= 0) || (sizeY <= 0)) {
+        fclose (fd);
+        return NULL;
+    }
+    sp = Sprite_Init (sizeX, sizeY);
+    for (y=0; y<sizeY; y++) {
+        for (x=0; x<sizeX; x++) {
+            if (fscanf (fd, "%2x%2x%2x", &red, &green, &blue) != 3) {
+                break;
+            }
+            if (((red << 16) | (green << 8) | blue) == keyColor) {
+                continue;
+            }
+            Sprite_SetColor (sp, x, y, red, green, blue);
+        }
+    }
+    fclose (fd);
+
+    return sp;
+}
+
+void Sprite_Free (Sprite sp) {
+    assert (sp != NULL);
+
+    free (sp->color);
+    free (sp->mask);
+    free (sp->rowType);
+    free (sp);
+}
+
+static void Sprite_UpdateRow (Sprite sp, int y) {
+    unsigned char *m;
+    int l, n, opaque;
+
+    m = sp->mask + 3 * y * sp->sizeX;
+    n = 0;
+    for (l=0; l<3*sp->sizeX; l++) {
+        n += (m[l] == 0);
+    }
+    opaque = 3 * sp->sizeX;
+    sp->rowType[y] = (n == opaque) ? ROW_OPAQUE : (n == 0) ? ROW_EMPTY
+            : ROW_MIXED;
+}
+
+void Sprite_SetColor (Sprite sp, int x, int y,
+        unsigned char red, unsigned char green, unsigned char blue) {
+    int i;
+
+    assert (sp != NULL);
+    assert ((x >= 0) && (x < sp->sizeX) && (y >= 0) && (y < sp->sizeY));
+
+    i = 3 * (y * sp->sizeX + x);
+    sp->color[i + RED]   = red;
+    sp->color[i + GREEN] = green;
+    sp->color[i + BLUE]  = blue;
+    sp->mask[i + RED]    = 0x00;
+    sp->mask[i + GREEN]  = 0x00;
+    sp->mask[i + BLUE]   = 0x00;
+    Sprite_UpdateRow (sp, y);
+}
+
+void Sprite_SetTransparent (Sprite sp, int x, int y) {
+    int i;
+
+    assert (sp != NULL);
+    assert ((x >= 0) && (x < sp->sizeX) && (y >= 0) && (y < sp->sizeY));
+
+    i = 3 * (y * sp->sizeX + x);
+    sp->color[i + RED]   = 0;
+    sp->color[i + GREEN] = 0;
+    sp->color[i + BLUE]  = 0;
+    sp->mask[i + RED]    = 0xFF;
+    sp->mask[i + GREEN]  = 0xFF;
+    sp->mask[i + BLUE]   = 0xFF;
+    Sprite_UpdateRow (sp, y);
+}
+
+int Sprite_GetSizeX (Sprite sp) {
+    assert (sp != NULL);
+
+    return sp->sizeX;
+}
+
+int Sprite_GetSizeY (Sprite sp) {
+    assert (sp != NULL);
+
+    return sp->sizeY;
+}
+
+//
+// Zeichnet 'n' Pixel der Sprite-Zeile (color, mask) nach 'dst'.
+//
+static void Sprite_BlitSpan (unsigned char *dst, unsigned char *color,
+        unsigned char *mask, int rowType, int n) {
+    int l;
+
+    if (rowType == ROW_OPAQUE) {
+        memcpy (dst, color, 3*n);
+        return;
+    }
+    for (l=0; l<3*n; l++) {
+        dst[l] = (dst[l] & mask[l]) | color[l];
+    }
+}
+
+//
+// Zeichnet das Sprite mit der linken oberen Ecke bei (x,y) in das Bild,
+// in welches gezeichnet wird. Was ausserhalb des Bildes liegt, wird
+// abgeschnitten.
+//
+void LedGrid_DrawSprite (LedGrid lg, Sprite sp, int x, int y) {
+    LedImage *im;
+    unsigned char *color, *mask, *row;
+    int img, x0, x1, y0, y1, sy, px, py, n, k;
+
+    assert (lg != NULL);
+    assert (sp != NULL);
+
+    img = LEDGRID_DRAWIMAGE(lg);
+    im  = &lg->image[img];
+
+    x0 = (x < 0) ? -x : 0;
+    y0 = (y < 0) ? -y : 0;
+    x1 = (x + sp->sizeX > im->sizeX) ? im->sizeX - x : sp->sizeX;
+    y1 = (y + sp->sizeY > im->sizeY) ? im->sizeY - y : sp->sizeY;
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return;
+    }
+    n  = x1 - x0;
+    px = (x + x0 + im->originX) % im->sizeX;
+    k  = (px + n > im->sizeX) ? im->sizeX - px : n;
+    for (sy=y0; sy<y1; sy++) {
+        if (sp->rowType[sy] == ROW_EMPTY) {
+            continue;
+        }
+        py    = (y + sy + im->originY) % im->sizeY;
+        row   = lg->field[img][py];
+        color = sp->color + 3 * (sy * sp->sizeX + x0);
+        mask  = sp->mask + 3 * (sy * sp->sizeX + x0);
+        Sprite_BlitSpan (row + 3*px, color, mask, sp->rowType[sy], k);
+        if (k < n) {
+            Sprite_BlitSpan (row, color + 3*k, mask + 3*k, sp->rowType[sy],
+                    n - k);
+        }
+    }
+}
+
+//
+// Zeichnet 'count' Sprites in einem Aufruf; 'x' und 'y' enthalten die
+// Positionen der einzelnen Sprites. Gezeichnet wird in der Reihenfolge
+// des Arrays, spaetere Sprites ueberdecken also fruehere.
+//
+void LedGrid_DrawSprites (LedGrid lg, Sprite *sp, int *x, int *y,
+        int count) {
+    int i;
+
+    assert (lg != NULL);
+    assert ((sp != NULL) && (x != NULL) && (y != NULL));
+
+    for (i=0; i<count; i++) {
+        LedGrid_DrawSprite (lg, sp[i], x[i], y[i]);
+    }
+}
+
+/*
+ * LedText --
+ */
+
+//
+// Lauftext: Die ganze Nachricht wird einmal in ein Canvas der LedGrid
+// gezeichnet, gefolgt von einer Luecke in der Breite des Panels. Zum
+// Scrollen wird nur noch der Ausschnitt (viewport) verschoben; da dieser
+// am Rand des Canvas umbricht, laeuft der Text endlos durch. Bei einer
+// Aenderung des Textes werden nur die Zeichen neu gezeichnet, die sich
+// tatsaechlich geaendert haben.
+//
+#define LEDTEXT_FIRST_CHAR  0x20
+#define LEDTEXT_LAST_CHAR   0x7E
+#define LEDTEXT_GLYPH_X     5
+#define LEDTEXT_GLYPH_Y     7
+#define LEDTEXT_CELL_X      (LEDTEXT_GLYPH_X + 1)
+
+//
+// 5x7-Zeichensatz fuer ASCII 0x20 bis 0x7E. Pro Zeichen 5 Spalten, das
+// niederwertigste Bit ist jeweils die oberste Zeile.
+//
+static const unsigned char LedText_Font[][LEDTEXT_GLYPH_X] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5f,0x00,0x00},
+    {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7f,0x14,0x7f,0x14},
+    {0x24,0x2a,0x7f,0x2a,0x12}, {0x23,0x13,0x08,0x64,0x62},
+    {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00},
+    {0x00,0x1c,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1c,0x00},
+    {0x14,0x08,0x3e,0x08,0x14}, {0x08,0x08,0x3e,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08},
+    {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+    {0x3e,0x51,0x49,0x45,0x3e}, {0x00,0x42,0x7f,0x40,0x00},
+    {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4b,0x31},
+    {0x18,0x14,0x12,0x7f,0x10}, {0x27,0x45,0x45,0x45,0x39},
+    {0x3c,0x4a,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1e},
+    {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+    {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14},
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+    {0x32,0x49,0x79,0x41,0x3e}, {0x7e,0x11,0x11,0x11,0x7e},
+    {0x7f,0x49,0x49,0x49,0x36}, {0x3e,0x41,0x41,0x41,0x22},
+    {0x7f,0x41,0x41,0x22,0x1c}, {0x7f,0x49,0x49,0x49,0x41},
+    {0x7f,0x09,0x09,0x09,0x01}, {0x3e,0x41,0x49,0x49,0x7a},
+    {0x7f,0x08,0x08,0x08,0x7f}, {0x00,0x41,0x7f,0x41,0x00},
+    {0x20,0x40,0x41,0x3f,0x01}, {0x7f,0x08,0x14,0x22,0x41},
+    {0x7f,0x40,0x40,0x40,0x40}, {0x7f,0x02,0x0c,0x02,0x7f},
+    {0x7f,0x04,0x08,0x10,0x7f}, {0x3e,0x41,0x41,0x41,0x3e},
+    {0x7f,0x09,0x09,0x09,0x06}, {0x3e,0x41,0x51,0x21,0x5e},
+    {0x7f,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+    {0x01,0x01,0x7f,0x01,0x01}, {0x3f,0x40,0x40,0x40,0x3f},
+    {0x1f,0x20,0x40,0x20,0x1f}, {0x3f,0x40,0x38,0x40,0x3f},
+    {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07},
+    {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7f,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7f,0x00},
+    {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78},
+    {0x7f,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20},
+    {0x38,0x44,0x44,0x48,0x7f}, {0x38,0x54,0x54,0x54,0x18},
+    {0x08,0x7e,0x09,0x01,0x02}, {0x0c,0x52,0x52,0x52,0x3e},
+    {0x7f,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7d,0x40,0x00},
+    {0x20,0x40,0x44,0x3d,0x00}, {0x7f,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7f,0x40,0x00}, {0x7c,0x04,0x18,0x04,0x78},
+    {0x7c,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+    {0x7c,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7c},
+    {0x7c,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3f,0x44,0x40,0x20}, {0x3c,0x40,0x40,0x20,0x7c},
+    {0x1c,0x20,0x40,0x20,0x1c}, {0x3c,0x40,0x30,0x40,0x3c},
+    {0x44,0x28,0x10,0x28,0x44}, {0x0c,0x50,0x50,0x50,0x3c},
+    {0x44,0x64,0x54,0x4c,0x44}, {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x7f,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00},
+    {0x10,0x08,0x08,0x10,0x08},
+};
+
+struct LedText {
+    LedGrid lg;
+    int image;
+    char *text;
+    int length;
+    int gap, top;
+    unsigned char color[3];
+};
+
+LedText LedText_Init (LedGrid lg) {
+    LedText lt;
+
+    assert (lg != NULL);
+
+    lt = malloc (sizeof (*lt));
+    lt->lg       = lg;
+    lt->image    = LedGrid_NewCanvas (lg, lg->sizeX, lg->sizeY);
+    lt->text     = strdup ("");
+    lt->length   = 0;
+    lt->gap      = lg->sizeX;
+    lt->top      = (lg->sizeY - LEDTEXT_GLYPH_Y) / 2;
+    lt->color[RED]   = 0xFF;
+    lt->color[GREEN] = 0xFF;
+    lt->color[BLUE]  = 0xFF;
+
+    return lt;
+}
+
+//
+// Das Canvas bleibt Teil der LedGrid, da sich Bilder nicht einzeln
+// freigeben lassen.
+//
+void LedText_Free (LedText lt) {
+    assert (lt != NULL);
+
+    free (lt->text);
+    free (lt);
+}
+
+//
+// Zeichnet die Zeichen 'from' bis 'to' (exklusive) von 'text' an ihre
+// Position im Canvas.
+//
+static void LedText_Render (LedText lt, char *text, int from, int to) {
+    const unsigned char *glyph;
+    unsigned char *pixel;
+    int i, c, r, y, ch;
+
+    for (i=from; i<to; i++) {
+        ch = (unsigned char) text[i];
+        if ((ch < LEDTEXT_FIRST_CHAR) || (ch > LEDTEXT_LAST_CHAR)) {
+            ch = '?';
+        }
+        glyph = LedText_Font[ch - LEDTEXT_FIRST_CHAR];
+        for (r=0; r<LEDTEXT_GLYPH_Y; r++) {
+            y = lt->top + r;
+            if ((y < 0) || (y >= lt->lg->sizeY)) {
+                continue;
+            }
+            pixel = lt->lg->field[lt->image][y] + 3 * i * LEDTEXT_CELL_X;
+            for (c=0; c<LEDTEXT_GLYPH_X; c++, pixel+=3) {
+                if (glyph[c] & (1 << r)) {
+                    memcpy (pixel, lt->color, 3);
+                } else {
+                    memset (pixel, 0, 3);
+                }
+            }
+            memset (pixel, 0, 3);
+        }
+    }
+}
+
+//
+// Setzt einen neuen Text. Gleich gebliebene Zeichen am Anfang werden nicht
+// angeruehrt; aendert sich die Laenge, so wird das gleich gebliebene Ende
+// spaltenweise verschoben statt neu gezeichnet.
+//
+void LedText_SetText (LedText lt, char *text) {
+    LedGrid lg;
+    int len, pre, suf, oldW, newW, y;
+    unsigned char *row;
+
+    assert (lt != NULL);
+    assert (text != NULL);
+
+    lg  = lt->lg;
+    len = strlen (text);
+    pre = 0;
+    while ((pre < len) && (pre < lt->length) && (text[pre] == lt->text[pre])) {
+        pre++;
+    }
+    suf = 0;
+    while ((suf < len - pre) && (suf < lt->length - pre)
+            && (text[len-1-suf] == lt->text[lt->length-1-suf])) {
+        suf++;
+    }
+
+    Semaphore_P (lg->sem);
+    LedGrid_NormalizeImage (lg, lt->image);
+    if (len != lt->length) {
+        oldW = lt->length * LEDTEXT_CELL_X;
+        newW = len * LEDTEXT_CELL_X;
+        if (newW > oldW) {
+            LedGrid_ResizeImage (lg, lt->image, newW + lt->gap);
+        }
+        for (y=0; y<lg->sizeY; y++) {
+            row = lg->field[lt->image][y];
+            memmove (row + 3 * (len - suf) * LEDTEXT_CELL_X,
+                    row + 3 * (lt->length - suf) * LEDTEXT_CELL_X,
+                    3 * suf * LEDTEXT_CELL_X);
+            memset (row + 3*newW, 0, 3 * lt->gap);
+        }
+        if (newW < oldW) {
+            LedGrid_ResizeImage (lg, lt->image, newW + lt->gap);
+        }
+    }
+    LedText_Render (lt, text, pre, len - suf);
+    Semaphore_V (lg->sem);
+
+    free (lt->text);
+    lt->text   = strdup (text);
+    lt->length = len;
+}
+
+char *LedText_GetText (LedText lt) {
+    assert (lt != NULL);
+
+    return lt->text;
+}
+
+//
+// Eine neue Farbe betrifft alle Zeichen, der Text wird also komplett neu
+// gezeichnet.
+//
+void LedText_SetColor (LedText lt, unsigned char red, unsigned char green,
+        unsigned char blue) {
+    assert (lt != NULL);
+
+    lt->color[RED]   = red;
+    lt->color[GREEN] = green;
+    lt->color[BLUE]  = blue;
+
+    Semaphore_P (lt->lg->sem);
+    LedGrid_NormalizeImage (lt->lg, lt->image);
+    LedText_Render (lt, lt->text, 0, lt->length);
+    Semaphore_V (lt->lg->sem);
+}
+
+//
+// Liefert den Index des Canvas, damit es mit 'LedGrid_SetImage' angezeigt
+// werden kann.
+//
+int LedText_GetImage (LedText lt) {
+    assert (lt != NULL);
+
+    return lt->image;
+}
+
+//
+// Verschiebt den Text um 'dx' Spalten nach links (bzw. nach rechts fuer
+// negative Werte).
+//
+void LedText_Scroll (LedText lt, int dx) {
+    LedImage *im;
+
+    assert (lt != NULL);
+
+    im = &lt->lg->image[lt->image];
+    LedText_SetPosition (lt, im->viewX + dx);
+}
+
+//
+// Setzt die Spalte des Textes, welche am linken Rand des Panels angezeigt
+// wird.
+//
+void LedText_SetPosition (LedText lt, int x) {
+    LedImage *im;
+
+    assert (lt != NULL);
+
+    im = &lt->lg->image[lt->image];
+    x %= im->sizeX;
+    im->viewX = (x < 0) ? x + im->sizeX : x;
+}
+
+/*
+ * Particles --
+ */
+
+//
+// Partikel fuer Feuer, Regen, Funken und aehnliches. Alle Daten liegen in
+// getrennten Arrays fester Groesse (ein Array pro Eigenschaft), so dass die
+// Aktualisierung aus einfachen Schleifen ueber 'int'-Arrays besteht.
+// Positionen und Geschwindigkeiten sind Fixpunkt-Zahlen mit 16 Bit
+// Nachkommastellen. Abgelaufene Partikel werden durch das letzte lebende
+// ersetzt; die lebenden Partikel liegen damit immer in [0,count).
+// Nach 'Particles_Init' wird kein Speicher mehr angefordert.
+//
+#define PARTICLES_ONE  (1 << 16)
+
+struct Particles {
+    int capacity, count;
+    int *posX, *posY;
+    int *velX, *velY;
+    int *life, *lifeTotal;
+    unsigned char *color;
+    int gravX, gravY;
+};
+
+Particles Particles_Init (int capacity) {
+    Particles ps;
+
+    assert (capacity > 0);
+
+    ps = malloc (sizeof (*ps));
+    ps->capacity  = capacity;
+    ps->count     = 0;
+    ps->posX      = calloc (capacity, sizeof (int));
+    ps->posY      = calloc (capacity, sizeof (int));
+    ps->velX      = calloc (capacity, sizeof (int));
+    ps->velY      = calloc (capacity, sizeof (int));
+    ps->life      = calloc (capacity, sizeof (int));
+    ps->lifeTotal = calloc (capacity, sizeof (int));
+    ps->color     = calloc (capacity, 3 * sizeof (unsigned char));
+    ps->gravX     = 0;
+    ps->gravY     = 0;
+
+    return ps;
+}
+
+void Particles_Free (Particles ps) {
+    assert (ps != NULL);
+
+    free (ps->posX);
+    free (ps->posY);
+    free (ps->velX);
+    free (ps->velY);
+    free (ps->life);
+    free (ps->lifeTotal);
+    free (ps->color);
+    free (ps);
+}
+
+//
+// Beschleunigung, die in jedem Schritt zur Geschwindigkeit aller Partikel
+// addiert wird (in Pixel pro Schritt^2).
+//
+void Particles_SetGravity (Particles ps, float gravX, float gravY) {
+    assert (ps != NULL);
+
+    ps->gravX = (int) (gravX * PARTICLES_ONE);
+    ps->gravY = (int) (gravY * PARTICLES_ONE);
+}
+
+//
+// Erzeugt ein neues Partikel, das 'life' Schritte lebt. Ist der Vorrat
+// erschoepft, wird -1 geliefert und kein Partikel erzeugt.
+//
+int Particles_Emit (Particles ps, float x, float y, float velX, float velY,
+        int life, unsigned char red, unsigned char green,
+        unsigned char blue) {
+    int i;
+
+    assert (ps != NULL);
+    assert (life > 0);
+
+    if (ps->count >= ps->capacity) {
+        return -1;
+    }
+    i = ps->count++;
+    ps->posX[i]      = (int) (x * PARTICLES_ONE);
+    ps->posY[i]      = (int) (y * PARTICLES_ONE);
+    ps->velX[i]      = (int) (velX * PARTICLES_ONE);
+    ps->velY[i]      = (int) (velY * PARTICLES_ONE);
+    ps->life[i]      = life;
+    ps->lifeTotal[i] = life;
+    ps->color[3*i + RED]   = red;
+    ps->color[3*i + GREEN] = green;
+    ps->color[3*i + BLUE]  = blue;
+
+    return i;
+}
+
+int Particles_GetCount (Particles ps) {
+    assert (ps != NULL);
+
+    return ps->count;
+}
+
+void Particles_Clear (Particles ps) {
+    assert (ps != NULL);
+
+    ps->count = 0;
+}
+
+//
+// Entfernt das Partikel 'i', indem das letzte an seine Stelle kopiert wird.
+//
+static void Particles_Remove (Particles ps, int i) {
+    int j;
+
+    j = --ps->count;
+    ps->posX[i]      = ps->posX[j];
+    ps->posY[i]      = ps->posY[j];
+    ps->velX[i]      = ps->velX[j];
+    ps->velY[i]      = ps->velY[j];
+    ps->life[i]      = ps->life[j];
+    ps->lifeTotal[i] = ps->lifeTotal[j];
+    memcpy (ps->color + 3*i, ps->color + 3*j, 3);
+}
+
+//
+// Bewegt alle Partikel um einen Schritt. Die Schleifen enthalten keine
+// Verzweigungen und koennen vom Compiler vektorisiert werden; erst danach
+// werden abgelaufene Partikel entfernt.
+//
+void Particles_Update (Particles ps) {
+    int *posX, *posY, *velX, *velY, *life;
+    int i, n, gravX, gravY;
+
+    assert (ps != NULL);
+
+    posX  = ps->posX;
+    posY  = ps->posY;
+    velX  = ps->velX;
+    velY  = ps->velY;
+    life  = ps->life;
+    gravX = ps->gravX;
+    gravY = ps->gravY;
+    n     = ps->count;
+
+    for (i=0; i<n; i++) {
+        posX[i] += velX[i];
+        posY[i] += velY[i];
+        velX[i] += gravX;
+        velY[i] += gravY;
+        life[i] -= 1;
+    }
+    for (i=n-1; i>=0; i--) {
+        if (life[i] <= 0) {
+            Particles_Remove (ps, i);
+        }
+    }
+}
+
+//
+// Addiert alle Partikel in das Bild, in welches gezeichnet wird. Die
+// Helligkeit eines Partikels nimmt mit seiner verbleibenden Lebensdauer
+// linear ab; die Farbwerte werden bei 255 abgeschnitten.
+//
+void LedGrid_DrawParticles (LedGrid lg, Particles ps) {
+    LedImage *im;
+    unsigned char *pixel, *color;
+    int i, k, x, y, img, alpha, value;
+
+    assert (lg != NULL);
+    assert (ps != NULL);
+
+    img = LEDGRID_DRAWIMAGE(lg);
+    im  = &lg->image[img];
+
+    for (i=0; i<ps->count; i++) {
+        x = ps->posX[i] >> 16;
+        y = ps->posY[i] >> 16;
+        if ((x < 0) || (x >= im->sizeX) || (y < 0) || (y >= im->sizeY)) {
+            continue;
+        }
+        alpha = (ps->life[i] << 8) / ps->lifeTotal[i];
+        pixel = LedGrid_Pixel (lg, img, x, y);
+        color = ps->color + 3*i;
+        for (k=0; k<3; k++) {
+            value = pixel[k] + ((color[k] * alpha) >> 8);
+            pixel[k] = (value > 255) ? 255 : value;
+        }
+    }
+}
+
+/*
+ * CellAuto --
+ */
+
+//
+// Zellulaere Automaten mit zwei Zustaenden und Regeln der Form B.../S...
+// (Geburt bzw. Ueberleben bei einer bestimmten Anzahl lebender Nachbarn).
+// Jede Zeile des Feldes ist in 64-Bit-Worte gepackt; Bit i von Wort k ist
+// die Zelle x = 64*k + i. Fuer jede Zeile werden die um eine Zelle nach
+// links und rechts verschobenen Zeilen vorberechnet ('west', 'east'), dann
+// werden die acht Nachbar-Worte mit einem bitweisen Addierer in vier
+// Bit-Ebenen aufsummiert. So werden 64 Zellen mit einigen Dutzend
+// Wort-Operationen berechnet, ohne Verzweigung pro Zelle.
+//
+struct CellAuto {
+    int sizeX, sizeY, words;
+    int wrap;
+    uint64_t lastMask;
+    uint64_t *cell, *next;
+    uint64_t *west, *east, *zero;
+    unsigned int birth, survive;
+};
+
+CellAuto CellAuto_Init (int sizeX, int sizeY, int wrap) {
+    CellAuto ca;
+
+    assert ((sizeX > 0) && (sizeY > 0));
+
+    ca = malloc (sizeof (*ca));
+    ca->sizeX = sizeX;
+    ca->sizeY = sizeY;
+    ca->words = (sizeX + 63) / 64;
+    ca->wrap  = wrap;
+    ca->lastMask = (sizeX % 64) ? ((uint64_t) 1 << (sizeX % 64)) - 1
+            : ~(uint64_t) 0;
+    ca->cell = calloc (sizeY * ca->words, sizeof (uint64_t));
+    ca->next = calloc (sizeY * ca->words, sizeof (uint64_t));
+    ca->west = calloc (sizeY * ca->words, sizeof (uint64_t));
+    ca->east = calloc (sizeY * ca->words, sizeof (uint64_t));
+    ca->zero = calloc (ca->words, sizeof (uint64_t));
+    CellAuto_SetRule (ca, 1 << 3, (1 << 2) | (1 << 3));
+
+    return ca;
+}
+
+void CellAuto_Free (CellAuto ca) {
+    assert (ca != NULL);
+
+    free (ca->cell);
+    free (ca->next);
+    free (ca->west);
+    free (ca->east);
+    free (ca->zero);
+    free (ca);
+}
+
+//
+// Bit n von 'birth' bzw. 'survive' gibt an, ob eine Zelle mit n lebenden
+// Nachbarn geboren wird bzw. ueberlebt (n = 0..8).
+//
+void CellAuto_SetRule (CellAuto ca, unsigned int birth, unsigned int survive) {
+    assert (ca != NULL);
+
+    ca->birth   = birth & 0x1FF;
+    ca->survive = survive & 0x1FF;
+}
+
+//
+// Setzt die Regel in der ueblichen Schreibweise, z.B. "B3/S23" fuer Life
+// oder "B36/S23" fuer HighLife. Liefert -1, falls die Regel nicht gelesen
+// werden kann.
+//
+int CellAuto_SetRuleString (CellAuto ca, char *rule) {
+    unsigned int birth, survive, *mask;
+    char *c;
+
+    assert (ca != NULL);
+    assert (rule != NULL);
+
+    birth = survive = 0;
+    mask  = NULL;
+    for (c=rule; *c != '\0'; c++) {
+        if ((*c == 'B') || (*c == 'b')) {
+            mask = &birth;
+        } else if ((*c == 'S') || (*c == 's')) {
+            mask = &survive;
+        } else if ((*c >= '0') && (*c <= '8') && (mask != NULL)) {
+            *mask |= 1 << (*c - '0');
+        } else if (*c != '/') {
+            return -1;
+        }
+    }
+    CellAuto_SetRule (ca, birth, survive);
+
+    return 0;
+}
+
+void CellAuto_SetCell (CellAuto ca, int x, int y, int alive) {
+    uint64_t *word, bit;
+
+    assert (ca != NULL);
+    assert ((x >= 0) && (x < ca->sizeX) && (y >= 0) && (y < ca->sizeY));
+
+    word = &ca->cell[y * ca->words + x / 64];
+    bit  = (uint64_t) 1 << (x % 64);
+    *word = alive ? (*word | bit) : (*word & ~bit);
+}
+
+int CellAuto_GetCell (CellAuto ca, int x, int y) {
+    assert (ca != NULL);
+    assert ((x >= 0) && (x < ca->sizeX) && (y >= 0) && (y < ca->sizeY));
+
+    return (ca->cell[y * ca->words + x / 64] >> (x % 64)) & 1;
+}
+
+void CellAuto_Clear (CellAuto ca) {
+    assert (ca != NULL);
+
+    memset (ca->cell, 0, ca->sizeY * ca->words * sizeof (uint64_t));
+}
+
+//
+// Belegt das Feld zufaellig; 'density' ist der Anteil lebender Zellen.
+//
+void CellAuto_Randomize (CellAuto ca, float density) {
+    int x, y;
+
+    assert (ca != NULL);
+
+    for (y=0; y<ca->sizeY; y++) {
+        for (x=0; x<ca->sizeX; x++) {
+            CellAuto_SetCell (ca, x, y, random () < density * RAND_MAX);
+        }
+    }
+}
+
+int CellAuto_GetPopulation (CellAuto ca) {
+    int i, count;
+
+    assert (ca != NULL);
+
+    count = 0;
+    for (i=0; i<ca->sizeY * ca->words; i++) {
+        count += __builtin_popcountll (ca->cell[i]);
+    }
+    return count;
+}
+
+//
+// Berechnet fuer die Zeile 'row' die Nachbarn links ('west', Bit x enthaelt
+// Zelle x-1) und rechts ('east', Bit x enthaelt Zelle x+1).
+//
+static void CellAuto_ShiftRow (CellAuto ca, uint64_t *row, uint64_t *west,
+        uint64_t *east) {
+    uint64_t first, last;
+    int k, n;
+
+    n = ca->words;
+    for (k=0; k<n; k++) {
+        west[k] = (row[k] << 1) | ((k > 0) ? row[k-1] >> 63 : 0);
+        east[k] = (row[k] >> 1) | ((k < n-1) ? row[k+1] << 63 : 0);
+    }
+    if (ca->wrap) {
+        first = row[0] & 1;
+        last  = (row[n-1] >> ((ca->sizeX - 1) % 64)) & 1;
+        west[0]   |= last;
+        east[n-1] |= first << ((ca->sizeX - 1) % 64);
+    }
+}
+
+//
+// Addiert das Wort 'n' bitweise zum vierstelligen Zaehler (c0..c3).
+//
+#define CELLAUTO_ADD(c0,c1,c2,c3,n) { \
+        uint64_t carry; \
+        carry = c0 & (n); c0 ^= (n); \
+        c3 |= c2 & carry & c1; \
+        c2 ^= c1 & carry; \
+        c1 ^= carry; \
+    }
+
+//
+// Berechnet eine Generation.
+//
+void CellAuto_Step (CellAuto ca) {
+    uint64_t *up, *upW, *upE, *cur, *curW, *curE, *dn, *dnW, *dnE;
+    uint64_t c0, c1, c2, c3, alive, eq, result, *tmp;
+    int y, k, n, yu, yd, words;
+
+    assert (ca != NULL);
+
+    words = ca->words;
+    for (y=0; y<ca->sizeY; y++) {
+        CellAuto_ShiftRow (ca, ca->cell + y * words, ca->west + y * words,
+                ca->east + y * words);
+    }
+
+    for (y=0; y<ca->sizeY; y++) {
+        yu = y - 1;
+        yd = y + 1;
+        if (ca->wrap) {
+            yu = (yu < 0) ? ca->sizeY - 1 : yu;
+            yd = (yd >= ca->sizeY) ? 0 : yd;
+        }
+        cur  = ca->cell + y * words;
+        curW = ca->west + y * words;
+        curE = ca->east + y * words;
+        if (yu >= 0) {
+            up  = ca->cell + yu * words;
+            upW = ca->west + yu * words;
+            upE = ca->east + yu * words;
+        } else {
+            up = upW = upE = ca->zero;
+        }
+        if (yd < ca->sizeY) {
+            dn  = ca->cell + yd * words;
+            dnW = ca->west + yd * words;
+            dnE = ca->east + yd * words;
+        } else {
+            dn = dnW = dnE = ca->zero;
+        }
+        for (k=0; k<words; k++) {
+            c0 = c1 = c2 = c3 = 0;
+            CELLAUTO_ADD(c0, c1, c2, c3, upW[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, up[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, upE[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, curW[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, curE[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, dnW[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, dn[k]);
+            CELLAUTO_ADD(c0, c1, c2, c3, dnE[k]);
+
+            alive  = cur[k];
+            result = 0;
+            for (n=0; n<=8; n++) {
+                if (((ca->birth | ca->survive) & (1 << n)) == 0) {
+                    continue;
+                }
+                eq = ((n & 1) ? c0 : ~c0) & ((n & 2) ? c1 : ~c1)
+                        & ((n & 4) ? c2 : ~c2) & ((n & 8) ? c3 : ~c3);
+                if (ca->birth & (1 << n)) {
+                    result |= eq & ~alive;
+                }
+                if (ca->survive & (1 << n)) {
+                    result |= eq & alive;
+                }
+            }
+            ca->next[y * words + k] = result;
+        }
+        ca->next[y * words + words - 1] &= ca->lastMask;
+    }
+
+    tmp      = ca->cell;
+    ca->cell = ca->next;
+    ca->next = tmp;
+}
+
+//
+// Zeichnet einen Ausschnitt des Feldes mit der linken oberen Ecke
+// (offX,offY) in das Bild, in welches gezeichnet wird. Lebende Zellen
+// erhalten die Farbe 'onColor', tote 'offColor' (jeweils 0xRRGGBB).
+// Der Ausschnitt wird am Rand des Feldes umgebrochen.
+//
+void LedGrid_DrawCellAuto (LedGrid lg, CellAuto ca, int offX, int offY,
+        unsigned int onColor, unsigned int offColor) {
+    LedImage *im;
+    unsigned char color[2][3], *pixel;
+    uint64_t *row;
+    int img, x, y, cx, cy;
+
+    assert (lg != NULL);
+    assert (ca != NULL);
+
+    color[0][RED]   = (offColor >> 16) & 0xFF;
+    color[0][GREEN] = (offColor >> 8) & 0xFF;
+    color[0][BLUE]  = offColor & 0xFF;
+    color[1][RED]   = (onColor >> 16) & 0xFF;
+    color[1][GREEN] = (onColor >> 8) & 0xFF;
+    color[1][BLUE]  = onColor & 0xFF;
+
+    img  = LEDGRID_DRAWIMAGE(lg);
+    im   = &lg->image[img];
+    offX = ((offX % ca->sizeX) + ca->sizeX) % ca->sizeX;
+    offY = ((offY % ca->sizeY) + ca->sizeY) % ca->sizeY;
+    for (y=0; y<im->sizeY; y++) {
+        cy  = (offY + y) % ca->sizeY;
+        row = ca->cell + cy * ca->words;
+        cx  = offX;
+        for (x=0; x<im->sizeX; x++) {
+            pixel = LedGrid_Pixel (lg, img, x, y);
+            memcpy (pixel, color[(row[cx / 64] >> (cx % 64)) & 1], 3);
+            if (++cx >= ca->sizeX) {
+                cx = 0;
+            }
+        }
+    }
+}
+
+/*
+ * Noise --
+ */
+
+//
+// Gradienten-Rauschen nach Perlin ("improved noise") in drei Dimensionen,
+// vollstaendig in Fixpunkt-Arithmetik. Koordinaten werden als 16.16-Zahlen
+// uebergeben; fuer Skalarprodukte und Interpolation werden 12 Bit der
+// Nachkommastellen verwendet, die Glaettungskurve 6t^5-15t^4+10t^3 kommt
+// aus einer Tabelle. Berechnet wird immer eine ganze Zeile: y und z sind
+// dort konstant, die Gradienten der acht Ecken einer Zelle werden nur
+// beim Wechsel in die naechste Zelle neu bestimmt.
+//
+#define NOISE_FADE_BITS  10
+#define NOISE_FRAC_BITS  12
+#define NOISE_ONE        (1 << NOISE_FRAC_BITS)
+
+static const signed char Noise_Grad[16][3] = {
+    { 1, 1, 0}, {-1, 1, 0}, { 1,-1, 0}, {-1,-1, 0},
+    { 1, 0, 1}, {-1, 0, 1}, { 1, 0,-1}, {-1, 0,-1},
+    { 0, 1, 1}, { 0,-1, 1}, { 0, 1,-1}, { 0,-1,-1},
+    { 1, 1, 0}, { 0,-1, 1}, {-1, 1, 0}, { 0,-1,-1},
+};
+
+struct Noise {
+    unsigned char perm[512];
+    int fade[1 << NOISE_FADE_BITS];
+    unsigned char *row;
+    int rowSize;
+};
+
+//
+// Die Permutations-Tabelle wird aus 'seed' erzeugt, gleiche Werte liefern
+// also das gleiche Rauschen.
+//
+Noise Noise_Init (unsigned int seed) {
+    Noise n;
+    unsigned char t;
+    double f;
+    int i, j;
+
+    n = malloc (sizeof (*n));
+    for (i=0; i<256; i++) {
+        n->perm[i] = i;
+    }
+    for (i=255; i>0; i--) {
+        seed = seed * 1103515245 + 12345;
+        j = (seed >> 16) % (i + 1);
+        t = n->perm[i];
+        n->perm[i] = n->perm[j];
+        n->perm[j] = t;
+    }
+    memcpy (n->perm + 256, n->perm, 256);
+
+    for (i=0; i<(1 << NOISE_FADE_BITS); i++) {
+        f = (double) i / (1 << NOISE_FADE_BITS);
+        n->fade[i] = (int) (65536.0 * f*f*f * (f * (f*6.0 - 15.0) + 10.0));
+    }
+    n->row     = NULL;
+    n->rowSize = 0;
+
+    return n;
+}
+
+void Noise_Free (Noise n) {
+    assert (n != NULL);
+
+    free (n->row);
+    free (n);
+}
+
+#define NOISE_LERP(a,b,t) ((a) + ((((b) - (a)) * (t)) >> 16))
+
+//
+// Berechnet 'count' Werte ab (x,y,z), wobei x jeweils um 'dx' erhoeht wird
+// (alles 16.16). Die Werte liegen in 0..255, 128 entspricht 0.
+//
+void Noise_FillRow (Noise n, int x, int dx, int y, int z, int count,
+        unsigned char *out) {
+    unsigned char *perm;
+    const signed char *g;
+    int gx[8], yz[8], d[8];
+    int i, c, cellX, X, Y, Z, A, B, hash[8];
+    int fx, fy, fz, u, v, w, value;
+
+    assert (n != NULL);
+    assert (out != NULL);
+
+    perm = n->perm;
+    Y  = (y >> 16) & 0xFF;
+    Z  = (z >> 16) & 0xFF;
+    fy = (y & 0xFFFF) >> (16 - NOISE_FRAC_BITS);
+    fz = (z & 0xFFFF) >> (16 - NOISE_FRAC_BITS);
+    v  = n->fade[(y & 0xFFFF) >> (16 - NOISE_FADE_BITS)];
+    w  = n->fade[(z & 0xFFFF) >> (16 - NOISE_FADE_BITS)];
+
+    cellX = (x >> 16) + 1;
+    for (i=0; i<count; i++, x+=dx) {
+        if ((x >> 16) != cellX) {
+            cellX = x >> 16;
+            X = cellX & 0xFF;
+            A = perm[X] + Y;
+            B = perm[X+1] + Y;
+            // Ecke c hat die Offsets (c&1, (c>>1)&1, (c>>2)&1).
+            hash[0] = perm[perm[A] + Z];
+            hash[1] = perm[perm[B] + Z];
+            hash[2] = perm[perm[A+1] + Z];
+            hash[3] = perm[perm[B+1] + Z];
+            hash[4] = perm[perm[A] + Z + 1];
+            hash[5] = perm[perm[B] + Z + 1];
+            hash[6] = perm[perm[A+1] + Z + 1];
+            hash[7] = perm[perm[B+1] + Z + 1];
+            for (c=0; c<8; c++) {
+                g = Noise_Grad[hash[c] & 15];
+                gx[c] = g[0];
+                yz[c] = g[1] * (fy - ((c >> 1) & 1) * NOISE_ONE)
+                      + g[2] * (fz - ((c >> 2) & 1) * NOISE_ONE);
+            }
+        }
+        fx = (x & 0xFFFF) >> (16 - NOISE_FRAC_BITS);
+        u  = n->fade[(x & 0xFFFF) >> (16 - NOISE_FADE_BITS)];
+        for (c=0; c<8; c++) {
+            d[c] = gx[c] * (fx - (c & 1) * NOISE_ONE) + yz[c];
+        }
+        d[0] = NOISE_LERP(d[0], d[1], u);
+        d[2] = NOISE_LERP(d[2], d[3], u);
+        d[4] = NOISE_LERP(d[4], d[5], u);
+        d[6] = NOISE_LERP(d[6], d[7], u);
+        d[0] = NOISE_LERP(d[0], d[2], v);
+        d[4] = NOISE_LERP(d[4], d[6], v);
+        d[0] = NOISE_LERP(d[0], d[4], w);
+
+        value = 128 + ((d[0] * 127) >> NOISE_FRAC_BITS);
+        out[i] = (value < 0) ? 0 : (value > 255) ? 255 : value;
+    }
+}
+
+//
+// Wandelt eine Koordinate in eine 16.16 Fixpunkt-Zahl um. Da das Rauschen
+// eine Periode von 256 besitzt, wird zuerst in den Bereich [0,256)
+// gebracht; so bleibt die Umwandlung auch fuer grosse Zeiten definiert.
+//
+static int Noise_Fixed (double t) {
+    t = fmod (t, 256.0);
+    if (t < 0.0) {
+        t += 256.0;
+    }
+    return (int) (t * 65536.0);
+}
+
+//
+// Fuellt 'out' (sizeX * sizeY Werte, zeilenweise) mit dem Rauschen an den
+// Stellen (x*scale, y*scale, time).
+//
+void Noise_FillFrame (Noise n, unsigned char *out, int sizeX, int sizeY,
+        float scale, float time) {
+    int y, step, z;
+
+    assert (n != NULL);
+    assert (out != NULL);
+
+    step = (int) (scale * 65536.0);
+    z    = Noise_Fixed (time);
+    for (y=0; y<sizeY; y++) {
+        Noise_FillRow (n, 0, step, y * step, z, sizeX, out + y * sizeX);
+    }
+}
+
+//
+// Zeichnet das Rauschen zum Zeitpunkt 'time' in das Bild, in welches
+// gezeichnet wird. Die Werte werden linear zwischen 'lowColor' und
+// 'highColor' (0xRRGGBB) abgebildet.
+//
+void LedGrid_DrawNoise (LedGrid lg, Noise n, float scale, float time,
+        unsigned int lowColor, unsigned int highColor) {
+    LedImage *im;
+    unsigned char map[256][3];
+    int img, i, k, x, y, step, z, lo, hi;
+
+    assert (lg != NULL);
+    assert (n != NULL);
+
+    for (k=0; k<3; k++) {
+        lo = (lowColor  >> (8 * (2-k))) & 0xFF;
+        hi = (highColor >> (8 * (2-k))) & 0xFF;
+        for (i=0; i<256; i++) {
+            map[i][k] = lo + ((hi - lo) * i) / 255;
+        }
+    }
+
+    img = LEDGRID_DRAWIMAGE(lg);
+    im  = &lg->image[img];
+    if (n->rowSize < im->sizeX) {
+        n->row     = realloc (n->row, im->sizeX);
+        n->rowSize = im->sizeX;
+    }
+    step = (int) (scale * 65536.0);
+    z    = Noise_Fixed (time);
+    for (y=0; y<im->sizeY; y++) {
+        Noise_FillRow (n, 0, step, y * step, z, im->sizeX, n->row);
+        for (x=0; x<im->sizeX; x++) {
+            memcpy (LedGrid_Pixel (lg, img, x, y), map[n->row[x]], 3);
+        }
+    }
+}
+
+/*
+ * Resampler --
+ */
+
+//
+// Skaliert RGB-Bilder beliebiger Groesse auf eine Zielgroesse. Fuer jede
+// Achse wird beim Erzeugen eine Tabelle berechnet: pro Zielpixel der erste
+// Quellpixel, die Anzahl Quellpixel und deren Gewichte (Summe
+// 1 << RESAMPLER_BITS). Beim Skalieren wird zuerst horizontal in Zeilen
+// mit 8 Bit Nachkommastellen, dann vertikal gefiltert; Quellzeilen, die
+// kein Gewicht erhalten, werden gar nicht gelesen.
+//
+#define RESAMPLER_BITS  14
+#define RESAMPLER_ONE   (1 << RESAMPLER_BITS)
+
+typedef struct {
+    int *start, *count, *offset;
+    int *weight;
+} ResamplerAxis;
+
+struct Resampler {
+    int srcX, srcY, dstX, dstY;
+    enum Resampler_FilterEnum filter;
+    enum Resampler_FitEnum fit;
+    int cropX, cropY, cropW, cropH;
+    int winX, winY, winW, winH;
+    ResamplerAxis axis[2];
+    unsigned short *tmp;
+    unsigned char *rowUsed;
+    unsigned char *out;
+};
+
+static void Resampler_FreeAxis (ResamplerAxis *ax) {
+    free (ax->start);
+    free (ax->count);
+    free (ax->offset);
+    free (ax->weight);
+}
+
+//
+// Berechnet die Tabelle einer Achse: 'n' Zielpixel aus den Quellpixeln
+// [s0, s0+sn).
+//
+static void Resampler_InitAxis (ResamplerAxis *ax,
+        enum Resampler_FilterEnum filter, int s0, int sn, int n) {
+    long long a, b, lo, hi;
+    int i, j, k, maxTaps, first, last, sum, big;
+    double c, f;
+
+    maxTaps = (filter == RESAMPLER_BOX) ? sn / n + 2 : 2;
+    ax->start  = calloc (n, sizeof (int));
+    ax->count  = calloc (n, sizeof (int));
+    ax->offset = calloc (n, sizeof (int));
+    ax->weight = calloc (n * maxTaps, sizeof (int));
+
+    k = 0;
+    for (i=0; i<n; i++) {
+        ax->offset[i] = k;
+        if (filter == RESAMPLER_BOX) {
+            a = ((long long) i * sn << 16) / n;
+            b = ((long long) (i+1) * sn << 16) / n;
+            first = a >> 16;
+            last  = (b - 1) >> 16;
+            for (j=first; j<=last; j++) {
+                lo = ((long long) j << 16 > a) ? (long long) j << 16 : a;
+                hi = ((long long) (j+1) << 16 < b) ? (long long) (j+1) << 16 : b;
+                ax->weight[k++] = ((hi - lo) * RESAMPLER_ONE) / (b - a);
+            }
+        } else {
+            c = (i + 0.5) * sn / n - 0.5;
+            c = (c < 0.0) ? 0.0 : (c > sn - 1) ? sn - 1 : c;
+            first = (int) c;
+            f = c - first;
+            last  = ((f > 0.0) && (first < sn - 1)) ? first + 1 : first;
+            ax->weight[k++] = (int) ((1.0 - f) * RESAMPLER_ONE + 0.5);
+            if (last > first) {
+                ax->weight[k++] = (int) (f * RESAMPLER_ONE + 0.5);
+            }
+        }
+        ax->start[i] = s0 + first;
+        ax->count[i] = last - first + 1;
+
+        // Rundungsfehler dem groessten Gewicht zuschlagen, damit eine
+        // einfarbige Flaeche exakt erhalten bleibt.
+        sum = 0;
+        big = ax->offset[i];
+        for (j=ax->offset[i]; j<k; j++) {
+            sum += ax->weight[j];
+            big  = (ax->weight[j] > ax->weight[big]) ? j : big;
+        }
+        ax->weight[big] += RESAMPLER_ONE - sum;
+    }
+}
+
+//
+// Bestimmt aus Ausschnitt und Anpassungsart das Zielfenster bzw. den
+// verwendeten Teil des Ausschnitts und berechnet die Tabellen neu.
+//
+static void Resampler_Setup (Resampler rs) {
+    int sx, sy, sw, sh, y, j, i;
+
+    sx = rs->cropX;
+    sy = rs->cropY;
+    sw = rs->cropW;
+    sh = rs->cropH;
+    rs->winX = 0;
+    rs->winY = 0;
+    rs->winW = rs->dstX;
+    rs->winH = rs->dstY;
+    if (rs->fit == RESAMPLER_FILL) {
+        if ((long long) sw * rs->dstY > (long long) sh * rs->dstX) {
+            sw  = (int) ((long long) sh * rs->dstX / rs->dstY);
+            sx += (rs->cropW - sw) / 2;
+        } else {
+            sh  = (int) ((long long) sw * rs->dstY / rs->dstX);
+            sy += (rs->cropH - sh) / 2;
+        }
+    } else if (rs->fit == RESAMPLER_CONTAIN) {
+        if ((long long) sw * rs->dstY > (long long) sh * rs->dstX) {
+            rs->winH = (int) ((long long) sh * rs->dstX / sw);
+            rs->winH = (rs->winH < 1) ? 1 : rs->winH;
+            rs->winY = (rs->dstY - rs->winH) / 2;
+        } else {
+            rs->winW = (int) ((long long) sw * rs->dstY / sh);
+            rs->winW = (rs->winW < 1) ? 1 : rs->winW;
+            rs->winX = (rs->dstX - rs->winW) / 2;
+        }
+    }
+
+    Resampler_FreeAxis (&rs->axis[0]);
+    Resampler_FreeAxis (&rs->axis[1]);
+    Resampler_InitAxis (&rs->axis[0], rs->filter, sx, sw, rs->winW);
+    Resampler_InitAxis (&rs->axis[1], rs->filter, sy, sh, rs->winH);
+
+    memset (rs->rowUsed, 0, rs->srcY);
+    for (y=0; y<rs->winH; y++) {
+        for (j=0; j<rs->axis[1].count[y]; j++) {
+            i = rs->axis[1].offset[y] + j;
+            if (rs->axis[1].weight[i] != 0) {
+                rs->rowUsed[rs->axis[1].start[y] + j] = 1;
+            }
+        }
+    }
+}
+
+Resampler Resampler_Init (int srcX, int srcY, int dstX, int dstY,
+        enum Resampler_FilterEnum filter, enum Resampler_FitEnum fit) {
+    Resampler rs;
+
+    assert ((srcX > 0) && (srcY > 0) && (dstX > 0) && (dstY > 0));
+
+    rs = calloc (1, sizeof (*rs));
+    rs->srcX    = srcX;
+    rs->srcY    = srcY;
+    rs->dstX    = dstX;
+    rs->dstY    = dstY;
+    rs->filter  = filter;
+    rs->fit     = fit;
+    rs->cropX   = 0;
+    rs->cropY   = 0;
+    rs->cropW   = srcX;
+    rs->cropH   = srcY;
+    rs->tmp     = calloc (srcY * dstX, 3 * sizeof (unsigned short));
+    rs->rowUsed = calloc (srcY, sizeof (unsigned char));
+    rs->out     = calloc (dstX * dstY, 3 * sizeof (unsigned char));
+    Resampler_Setup (rs);
+
+    return rs;
+}
+
+void Resampler_Free (Resampler rs) {
+    assert (rs != NULL);
+
+    Resampler_FreeAxis (&rs->axis[0]);
+    Resampler_FreeAxis (&rs->axis[1]);
+    free (rs->tmp);
+    free (rs->rowUsed);
+    free (rs->out);
+    free (rs);
+}
+
+//
+// Beschraenkt die Quelle auf das Rechteck (x,y,w,h).
+//
+void Resampler_SetCrop (Resampler rs, int x, int y, int w, int h) {
+    assert (rs != NULL);
+    assert ((x >= 0) && (y >= 0) && (w > 0) && (h > 0));
+    assert ((x + w <= rs->srcX) && (y + h <= rs->srcY));
+
+    rs->cropX = x;
+    rs->cropY = y;
+    rs->cropW = w;
+    rs->cropH = h;
+    Resampler_Setup (rs);
+}
+
+//
+// Skaliert das RGB-Bild 'src' (Zeilen im Abstand von 'srcStride' Bytes)
+// nach 'dst'. Bei RESAMPLER_CONTAIN bleiben die Raender schwarz.
+//
+void Resampler_Run (Resampler rs, const unsigned char *src, int srcStride,
+        unsigned char *dst, int dstStride) {
+    ResamplerAxis *ax, *ay;
+    const unsigned char *in;
+    unsigned short *tmp;
+    unsigned char *out;
+    int x, y, j, k, w, acc[3];
+
+    assert (rs != NULL);
+    assert ((src != NULL) && (dst != NULL));
+
+    ax = &rs->axis[0];
+    ay = &rs->axis[1];
+
+    for (y=0; y<rs->srcY; y++) {
+        if (!rs->rowUsed[y]) {
+            continue;
+        }
+        in  = src + y * srcStride;
+        tmp = rs->tmp + 3 * y * rs->winW;
+        for (x=0; x<rs->winW; x++) {
+            acc[0] = acc[1] = acc[2] = 0;
+            for (j=0; j<ax->count[x]; j++) {
+                w = ax->weight[ax->offset[x] + j];
+                k = 3 * (ax->start[x] + j);
+                acc[0] += in[k+0] * w;
+                acc[1] += in[k+1] * w;
+                acc[2] += in[k+2] * w;
+            }
+            tmp[3*x+0] = acc[0] >> (RESAMPLER_BITS - 8);
+            tmp[3*x+1] = acc[1] >> (RESAMPLER_BITS - 8);
+            tmp[3*x+2] = acc[2] >> (RESAMPLER_BITS - 8);
+        }
+    }
+
+    if (rs->fit == RESAMPLER_CONTAIN) {
+        for (y=0; y<rs->dstY; y++) {
+            memset (dst + y * dstStride, 0, 3 * rs->dstX);
+        }
+    }
+    for (y=0; y<rs->winH; y++) {
+        out = dst + (rs->winY + y) * dstStride + 3 * rs->winX;
+        for (x=0; x<3*rs->winW; x++) {
+            acc[0] = 0;
+            for (j=0; j<ay->count[y]; j++) {
+                w   = ay->weight[ay->offset[y] + j];
+                tmp = rs->tmp + 3 * (ay->start[y] + j) * rs->winW;
+                acc[0] += tmp[x] * w;
+            }
+            out[x] = (acc[0] + (1 << (RESAMPLER_BITS + 7))) >> (RESAMPLER_BITS + 8);
+        }
+    }
+}
+
+//
+// Skaliert 'src' in das Bild 'imgIndex' (bzw. bei einem negativen Index in
+// das Bild, in welches gezeichnet wird). Die Zielgroesse des Resamplers
+// muss der Groesse dieses Bildes entsprechen. Das Resultat landet zuerst
+// im Ausgabepuffer des Resamplers und wird dann zeilenweise (um den
+// Ursprung des Bildes in zwei Stuecken) kopiert.
+//
+void LedGrid_DrawResampled (LedGrid lg, Resampler rs,
+        const unsigned char *src, int srcStride, int imgIndex) {
+    LedImage *im;
+    unsigned char *buf, *row;
+    int img, y, ox, n;
+
+    assert (lg != NULL);
+    assert (rs != NULL);
+    assert (imgIndex < lg->numImages);
+
+    img = (imgIndex < 0) ? LEDGRID_DRAWIMAGE(lg) : imgIndex;
+    im  = &lg->image[img];
+    assert ((rs->dstX == im->sizeX) && (rs->dstY == im->sizeY));
+
+    n  = 3 * im->sizeX;
+    ox = 3 * im->originX;
+    Resampler_Run (rs, src, srcStride, rs->out, n);
+    for (y=0; y<im->sizeY; y++) {
+        buf = rs->out + y * n;
+        row = lg->field[img][(y + im->originY) % im->sizeY];
+        memcpy (row + ox, buf, n - ox);
+        memcpy (row, buf + n - ox, ox);
+    }
+}
+
+/*
+ * ColorGrid --
+ */
+
+//
+// Eine Farbfunktion ist eine von drei Arten: eine Funktion, welche pro Bild
+// eine ganze Zeile berechnet ('rowFunc'), eine Funktion pro Pixel ('func',
+// wird ueber 'ColorGrid_PixelRow' zeilenweise aufgerufen) oder eine
+// Offset-Tabelle ('offset'): Pixel p erhaelt dann den Wert
+// matrix[color][offset[p] + step]. Die Tabelle wird beim Hinzufuegen der
+// Funktion einmal berechnet. Als vierte Art kann die Funktion als
+// Ausdruck angegeben werden ('expr', siehe 'ColorExpr_Compile').
+//
+typedef struct ColorExpr *ColorExpr;
+
+typedef struct ColorFuncType {
+    ColorFunc *func;
+    ColorRowFunc *rowFunc;
+    ColorExpr expr;
+    int *offset;
+    enum LedGrid_SymmetryEnum symmetry;
+    char *name;
+} ColorFuncType;
+
+typedef struct ColorGrid {
+    LedGrid lg;
+    unsigned char *matrix[3];
+    unsigned char *zeroTable;
+    int size;
+    int numFadeSteps;
+    int64_t fadePos[3];
+    int fadeSpeed[3];
+    double maxValue[3], expValue[3];
+    int colorFunc[3];
+    int numColorFuncs;
+    ColorFuncType *colorFuncArray;
+    unsigned char *plane[3];
+    unsigned char *planeNext[3];
+    int64_t planePos[3];
+    int planeValid[3];
+    int *symFund[SYMMETRY_OCTANT+1], *symCopy[SYMMETRY_OCTANT+1];
+    int symNumFund[SYMMETRY_OCTANT+1], symNumCopy[SYMMETRY_OCTANT+1];
+    Semaphore sem;
+    int cacheOn, cacheStop;
+    unsigned char *cache[3];
+    int cacheValid[3], cacheGen[3];
+    Semaphore cacheLock, cacheWake;
+    pthread_t cacheThread;
+    int numThreads, poolStop;
+    pthread_t *poolThread;
+    pthread_barrier_t poolBarrier;
+    int jobMode[3], jobSync;
+    int64_t jobPos[3];
+} *ColorGrid;
+
+//
+// Anzahl Schritte einer ganzen Periode der Farbtabellen. Die Tabellen sind
+// doppelt so lang und enthalten die Periode zweimal; damit kann
+// 'offset + step' (beide kleiner als die Periode) ohne Modulo-Rechnung als
+// Index verwendet werden.
+//
+#define COLORGRID_PERIOD(cg) (2 * ((cg)->size-1) * (cg)->numFadeSteps)
+
+//
+// Position und Geschwindigkeit in der Farbtabelle sind Fixpunkt-Zahlen mit
+// 16 Bit Nachkommastellen ('fadePos', 'fadeSpeed'). Liegt die Position
+// zwischen zwei Schritten, wird zwischen den beiden Werten linear
+// interpoliert; so lassen sich auch langsame Animationen mit hoher
+// Bildrate fluessig darstellen. Die Position ist 64 Bit breit, da
+// COLORGRID_PERIOD * COLORGRID_ONE bei vielen Schritten (z.B. '-s 1821')
+// nicht mehr in ein 'int' passt; die Geschwindigkeit ist auf +/-32767
+// Schritte pro Aufruf beschraenkt.
+//
+#define COLORGRID_ONE  (1 << 16)
+#define COLORGRID_ONE64 ((int64_t) COLORGRID_ONE)
+
+static void ColorGrid_InvalidateCache (ColorGrid cg, int color);
+static void ColorExpr_Free (ColorExpr ex);
+
+//
+// Farbtabellen --
+//
+// Die Farbtabellen (Helligkeitsverlauf pro Kanal) werden nur einmal pro
+// Kombination von Maximalwert, Exponent, Groesse und Anzahl Schritte
+// berechnet und danach in einer globalen Liste aufbewahrt. Ein ColorGrid
+// haelt nur Zeiger auf diese Tabellen; 'ColorGrid_Recalc' tauscht den
+// Zeiger erst aus, wenn die Tabelle vollstaendig berechnet ist. Die
+// Tabellen werden nie veraendert und bis zum Programmende behalten; ist
+// ein PreCache offen, zeigen sie direkt in die eingeblendete Datei.
+//
+typedef struct ColorTable {
+    double max, exp;
+    int size, numFadeSteps;
+    unsigned char *table;
+    struct ColorTable *next;
+} ColorTable;
+
+static ColorTable *ColorGrid_TableList = NULL;
+static pthread_mutex_t ColorGrid_TableMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char ColorGrid_CurveValue (double x, int size, double e) {
+    double p = 256.0 / pow (e, 8.0);
+    double v;
+
+    x = x * (size-1.0);
+    v = p * floor (pow (2.0, (x-1.0)));
+    return (v>255) ? 255 : v;
+}
+
+static unsigned char *ColorGrid_GetTable (ColorGrid cg,
+        double max, double exp) {
+    struct {
+        double max, exp;
+        int32_t size, numFadeSteps;
+    } key;
+    ColorTable *ct;
+    unsigned char *table;
+    int i, j, n;
+
+    pthread_mutex_lock (&ColorGrid_TableMutex);
+    for (ct=ColorGrid_TableList; ct!=NULL; ct=ct->next) {
+        if ((ct->max == max) && (ct->exp == exp) && (ct->size == cg->size)
+                && (ct->numFadeSteps == cg->numFadeSteps)) {
+            break;
+        }
+    }
+    if (ct == NULL) {
+        ct = malloc (sizeof (ColorTable));
+        ct->max          = max;
+        ct->exp          = exp;
+        ct->size         = cg->size;
+        ct->numFadeSteps = cg->numFadeSteps;
+
+        memset (&key, 0, sizeof (key));
+        key.max          = max;
+        key.exp          = exp;
+        key.size         = cg->size;
+        key.numFadeSteps = cg->numFadeSteps;
+        ct->table = (unsigned char *) PreCache_Get (PRECACHE_CURVE, &key,
+                sizeof (key), 2 * COLORGRID_PERIOD(cg));
+        if (ct->table == NULL) {
+            table = malloc (2 * COLORGRID_PERIOD(cg));
+            n = (cg->size-1) * cg->numFadeSteps;
+            for (i=0, j=0; i<n; i++, j++) {
+                table[i] = ColorGrid_CurveValue ((double) j / (double) n,
+                        cg->size, exp);
+            }
+            for (j=n; j>0; i++, j--) {
+                table[i] = ColorGrid_CurveValue ((double) j / (double) n,
+                        cg->size, exp);
+            }
+            memcpy (table + COLORGRID_PERIOD(cg), table, COLORGRID_PERIOD(cg));
+            PreCache_Put (PRECACHE_CURVE, &key, sizeof (key), table,
+                    2 * COLORGRID_PERIOD(cg));
+            ct->table = table;
+        }
+
+        ct->next = ColorGrid_TableList;
+        ColorGrid_TableList = ct;
+    }
+    pthread_mutex_unlock (&ColorGrid_TableMutex);
+
+    return ct->table;
+}
+
+ColorGrid ColorGrid_Init (int size, int numFadeSteps, float gammaValue) {
+    ColorGrid cg;
+    int i;
+
+    assert ((size > 0) && (numFadeSteps > 0));
+
+    cg = malloc (sizeof (* cg));
+    cg->lg = LedGrid_Init (size, size, gammaValue);
+    cg->size = size;
+    cg->numFadeSteps = numFadeSteps;
+    cg->zeroTable = calloc (2*COLORGRID_PERIOD(cg), sizeof (unsigned char));
+    for (i=0; i<3; i++) {
+        cg->matrix[i] = cg->zeroTable;
+        cg->plane[i] = calloc (size * size, sizeof (unsigned char));
+        cg->planeNext[i] = calloc (size * size, sizeof (unsigned char));
+        cg->planeValid[i] = 0;
+        cg->fadePos[i]   = 0;
+        cg->fadeSpeed[i] = 0;
+    }
+    cg->numColorFuncs = 0;
+    cg->colorFuncArray = NULL;
+    cg->cacheOn = 0;
+    cg->numThreads = 1;
+    cg->poolThread = NULL;
+    for (i=0; i<=SYMMETRY_OCTANT; i++) {
+        cg->symFund[i] = NULL;
+        cg->symCopy[i] = NULL;
+    }
+    cg->sem = Semaphore_Init (1);
+
+    return cg;
+}
+
+void ColorGrid_Free (ColorGrid cg) {
+    int i;
+
+    assert (cg != NULL);
+
+    ColorGrid_SetCache (cg, 0);
+    ColorGrid_SetThreads (cg, 1);
+    for (i=0; i<3; i++) {
+        free (cg->plane[i]);
+        free (cg->planeNext[i]);
+    }
+    free (cg->zeroTable);
+    for (i=0; i<=SYMMETRY_OCTANT; i++) {
+        free (cg->symFund[i]);
+        free (cg->symCopy[i]);
+    }
+    for (i=0; i<cg->numColorFuncs; i++) {
+        if (cg->colorFuncArray[i].expr != NULL) {
+            ColorExpr_Free (cg->colorFuncArray[i].expr);
+        }
+        free (cg->colorFuncArray[i].offset);
+        free (cg->colorFuncArray[i].name);
+    }
+    free (cg->colorFuncArray);
+    LedGrid_Free (cg->lg);
+    free (cg);
+}
+
+void ColorGrid_Recalc (ColorGrid cg, int color, \
+        double max, double exp) {
+    unsigned char *table;
+
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+    assert ((max > 0.0) && (exp >= 1.0));
+
+    cg->maxValue[color] = max;
+    cg->expValue[color] = exp;
+
+    table = ColorGrid_GetTable (cg, max, exp);
+    if (table == cg->matrix[color]) {
+        return;
+    }
+    __atomic_store_n (&cg->matrix[color], table, __ATOMIC_RELEASE);
+    ColorGrid_InvalidateCache (cg, color);
+}
+
+void ColorGrid_SetGamma (ColorGrid cg, float gammaValue) {
+    assert (cg != NULL);
+
+    LedGrid_SetGamma (cg->lg, gammaValue);
+}
+
+void ColorGrid_WriteColorFile (ColorGrid cg, char *fileName) {
+    FILE *fd;
+    int i, j;
+
+    assert (cg != NULL);
+    assert (fileName != NULL);
+
+    fd = fopen (fileName, "w");
+    if (fd == NULL) {
+        fprintf (stderr, "ERROR: couldn't open file '%s'!\n", fileName);
+        exit (1);
+    }
+    fprintf (fd, "%d %d\n", cg->size, cg->numFadeSteps);
+    for (i=0; i<3; i++) {
+        fprintf (fd, "\n");
+        for (j=0; j<2*(cg->size-1)*cg->numFadeSteps; j++) {
+            fprintf (fd, "%3d ", cg->matrix[i][j]);
+            if ((j+1) % cg->numFadeSteps == 0) {
+                fprintf (fd, "\n");
+            }
+        }
+        fprintf (fd, "\n");
+    }
+    fclose (fd);
+}
+
+unsigned char ColorGrid_GetColor (ColorGrid cg, int color, int step) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+    assert (step >= 0);
+
+    return cg->matrix[color][step%(2*(cg->size-1)*cg->numFadeSteps)];
+}
+
+//
+// Bringt die Position des Kanals 'color' in den Bereich einer Periode.
+//
+static void ColorGrid_WrapPos (ColorGrid cg, int color) {
+    int64_t period;
+
+    period = COLORGRID_PERIOD(cg) * COLORGRID_ONE64;
+    cg->fadePos[color] %= period;
+    if (cg->fadePos[color] < 0) {
+        cg->fadePos[color] += period;
+    }
+}
+
+void ColorGrid_Fade (ColorGrid cg, int color) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    cg->fadePos[color] += cg->fadeSpeed[color];
+    ColorGrid_WrapPos (cg, color);
+}
+
+void ColorGrid_SetFadeIncr (ColorGrid cg, int color, int incr) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    cg->fadeSpeed[color] = incr * COLORGRID_ONE;
+}
+
+int  ColorGrid_GetFadeIncr (ColorGrid cg, int color) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    return cg->fadeSpeed[color] / COLORGRID_ONE;
+}
+
+void ColorGrid_IncrFadeIncr (ColorGrid cg, int color, int incrIncr) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    cg->fadeSpeed[color] += incrIncr * COLORGRID_ONE;
+}
+
+//
+// Wie 'ColorGrid_SetFadeIncr', aber mit Bruchteilen von Schritten pro
+// Aufruf von 'ColorGrid_Fade' (z.B. 0.1 fuer einen Schritt alle zehn
+// Bilder).
+//
+void ColorGrid_SetFadeSpeed (ColorGrid cg, int color, float speed) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    cg->fadeSpeed[color] = (int) lround (speed * COLORGRID_ONE);
+}
+
+float ColorGrid_GetFadeSpeed (ColorGrid cg, int color) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    return (float) cg->fadeSpeed[color] / COLORGRID_ONE;
+}
+
+void ColorGrid_SetFadeStep (ColorGrid cg, int color, int step) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+    assert (step >= 0);
+
+    cg->fadePos[color] = (step % COLORGRID_PERIOD(cg)) * COLORGRID_ONE64;
+}
+
+int  ColorGrid_GetFadeStep (ColorGrid cg, int color) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    return (int) (cg->fadePos[color] / COLORGRID_ONE);
+}
+
+void ColorGrid_IncrFadeStep (ColorGrid cg, int color, int stepIncr) {
+    assert (cg != NULL);
+    assert ((color >= 0) && (color <= 2));
+
+    cg->fadePos[color] += (stepIncr % COLORGRID_PERIOD(cg)) * COLORGRID_ONE64;
+    ColorGrid_WrapPos (cg, color);
+}
+
+//
+// Adapter fuer die Farbfunktionen pro Pixel: fuellt die Zeile 'y'.
+//
+static void ColorGrid_PixelRow (ColorGrid cg, ColorFunc *func, int color,
+        int y, int step, unsigned char *row) {
+    int x;
+
+    for (x=0; x<cg->size; x++) {
+        row[x] = func (cg, color, x, y, step);
+    }
+}
+
+//
+// Farbausdruecke --
+//
+// Farbfunktionen koennen auch als Ausdruck angegeben werden, z.B.
+//
+//     curve (10 * (x + y) + step)
+//     hypot (x - size/2, y - size/2) < 3 + 2 * sin (2 * pi * t) ? 255 : 0
+//
+// Variablen: x, y (Position), step (Schritt), t (step / period, 0..1).
+// Konstanten: size, period, pi. Operatoren: + - * / % < <= > >= == !=
+// && || ! ?: und Klammern. Funktionen: sin, cos, abs, sqrt, floor, min,
+// max, pow, atan2, hypot und curve (Wert der Farbtabelle des Kanals, wie
+// 'ColorGrid_GetColor'). Das Resultat wird auf 0..255 beschraenkt.
+//
+// Ein Ausdruck wird in Befehle fuer eine Registermaschine uebersetzt;
+// Teilausdruecke aus Konstanten werden dabei bereits ausgerechnet. Jedes
+// Register ist entweder ein Skalar (haengt nur von y und step ab, wird
+// einmal pro Zeile berechnet) oder ein Vektor mit einem Wert pro Pixel der
+// Zeile. Ausgewertet wird immer eine ganze Zeile.
+//
+#define COLOREXPR_MAX_NODES  256
+#define COLOREXPR_MAX_REGS    64
+
+enum ColorExpr_OpEnum {
+    EXPR_CONST, EXPR_VAR,
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_MOD,
+    EXPR_LT, EXPR_LE, EXPR_GT, EXPR_GE, EXPR_EQ, EXPR_NE,
+    EXPR_AND, EXPR_OR, EXPR_NOT, EXPR_NEG, EXPR_SEL,
+    EXPR_SIN, EXPR_COS, EXPR_ABS, EXPR_SQRT, EXPR_FLOOR,
+    EXPR_MIN, EXPR_MAX, EXPR_POW, EXPR_ATAN2, EXPR_HYPOT, EXPR_CURVE
+};
+
+//
+// Skalare Register 0..2 enthalten y, step und t, Vektorregister 0 die
+// x-Koordinaten. Operanden >= 0 bezeichnen Vektor-, Operanden < 0 (als
+// -1-k) Skalarregister.
+//
+enum { EXPR_REG_Y, EXPR_REG_STEP, EXPR_REG_T, EXPR_NUM_INPUTS };
+
+static struct {
+    char *name;
+    int op, numArgs;
+} ColorExpr_FuncTable[] = {
+    { "sin",   EXPR_SIN,   1 },
+    { "cos",   EXPR_COS,   1 },
+    { "abs",   EXPR_ABS,   1 },
+    { "sqrt",  EXPR_SQRT,  1 },
+    { "floor", EXPR_FLOOR, 1 },
+    { "min",   EXPR_MIN,   2 },
+    { "max",   EXPR_MAX,   2 },
+    { "pow",   EXPR_POW,   2 },
+    { "atan2", EXPR_ATAN2, 2 },
+    { "hypot", EXPR_HYPOT, 2 },
+    { "curve", EXPR_CURVE, 1 },
+    { NULL,    0,          0 }
+};
+
+typedef struct ColorExpr_Instr {
+    unsigned char op;
+    signed char dst, a, b, c;
+} ColorExpr_Instr;
+
+struct ColorExpr {
+    int size, period;
+    int numInstr, numScalars, numVectors;
+    ColorExpr_Instr *instr;
+    float *scalarInit;
+    float *xs;
+    int result;
+};
+
+typedef struct ColorExpr_Node {
+    int op;
+    float value;
+    int var;
+    struct ColorExpr_Node *arg[3];
+} ColorExpr_Node;
+
+typedef struct ColorExpr_Parser {
+    char *text;
+    int pos;
+    char *error;
+    int errorPos;
+    int numNodes;
+    ColorExpr_Node node[COLOREXPR_MAX_NODES];
+    ColorGrid cg;
+} ColorExpr_Parser;
+
+//
+// Fuehrt die Operation 'op' fuer 'n' Werte aus. 'sa', 'sb' und 'sc' sind
+// 0 fuer Skalare und 1 fuer Vektoren.
+//
+static void ColorExpr_Exec (int op, float *d, int n, float *a, int sa,
+        float *b, int sb, float *c, int sc, unsigned char *table,
+        int period) {
+    int i, k;
+
+    switch (op) {
+        case EXPR_ADD:
+            for (i=0; i<n; i++) d[i] = a[i*sa] + b[i*sb];
+            break;
+        case EXPR_SUB:
+            for (i=0; i<n; i++) d[i] = a[i*sa] - b[i*sb];
+            break;
+        case EXPR_MUL:
+            for (i=0; i<n; i++) d[i] = a[i*sa] * b[i*sb];
+            break;
+        case EXPR_DIV:
+            for (i=0; i<n; i++) d[i] = a[i*sa] / b[i*sb];
+            break;
+        case EXPR_MOD:
+            for (i=0; i<n; i++) d[i] = fmodf (a[i*sa], b[i*sb]);
+            break;
+        case EXPR_LT:
+            for (i=0; i<n; i++) d[i] = a[i*sa] < b[i*sb];
+            break;
+        case EXPR_LE:
+            for (i=0; i<n; i++) d[i] = a[i*sa] <= b[i*sb];
+            break;
+        case EXPR_GT:
+            for (i=0; i<n; i++) d[i] = a[i*sa] > b[i*sb];
+            break;
+        case EXPR_GE:
+            for (i=0; i<n; i++) d[i] = a[i*sa] >= b[i*sb];
+            break;
+        case EXPR_EQ:
+            for (i=0; i<n; i++) d[i] = a[i*sa] == b[i*sb];
+            break;
+        case EXPR_NE:
+            for (i=0; i<n; i++) d[i] = a[i*sa] != b[i*sb];
+            break;
+        case EXPR_AND:
+            for (i=0; i<n; i++) d[i] = (a[i*sa] != 0.0) && (b[i*sb] != 0.0);
+            break;
+        case EXPR_OR:
+            for (i=0; i<n; i++) d[i] = (a[i*sa] != 0.0) || (b[i*sb] != 0.0);
+            break;
+        case EXPR_NOT:
+            for (i=0; i<n; i++) d[i] = a[i*sa] == 0.0;
+            break;
+        case EXPR_NEG:
+            for (i=0; i<n; i++) d[i] = - a[i*sa];
+            break;
+        case EXPR_SEL:
+            for (i=0; i<n; i++) d[i] = (a[i*sa] != 0.0) ? b[i*sb] : c[i*sc];
+            break;
+        case EXPR_SIN:
+            for (i=0; i<n; i++) d[i] = sinf (a[i*sa]);
+            break;
+        case EXPR_COS:
+            for (i=0; i<n; i++) d[i] = cosf (a[i*sa]);
+            break;
+        case EXPR_ABS:
+            for (i=0; i<n; i++) d[i] = fabsf (a[i*sa]);
+            break;
+        case EXPR_SQRT:
+            for (i=0; i<n; i++) d[i] = sqrtf (a[i*sa]);
+            break;
+        case EXPR_FLOOR:
+            for (i=0; i<n; i++) d[i] = floorf (a[i*sa]);
+            break;
+        case EXPR_MIN:
+            for (i=0; i<n; i++) d[i] = fminf (a[i*sa], b[i*sb]);
+            break;
+        case EXPR_MAX:
+            for (i=0; i<n; i++) d[i] = fmaxf (a[i*sa], b[i*sb]);
+            break;
+        case EXPR_POW:
+            for (i=0; i<n; i++) d[i] = powf (a[i*sa], b[i*sb]);
+            break;
+        case EXPR_ATAN2:
+            for (i=0; i<n; i++) d[i] = atan2f (a[i*sa], b[i*sb]);
+            break;
+        case EXPR_HYPOT:
+            for (i=0; i<n; i++) d[i] = hypotf (a[i*sa], b[i*sb]);
+            break;
+        case EXPR_CURVE:
+            for (i=0; i<n; i++) {
+                k = (int) floorf (a[i*sa]) % period;
+                d[i] = table[(k < 0) ? k + period : k];
+            }
+            break;
+    }
+}
+
+//
+// Merkt sich den ersten Fehler. Geliefert wird der Knoten 0 (Konstante 0),
+// damit die Analyse ohne Sonderfaelle zu Ende laufen kann.
+//
+static ColorExpr_Node *ColorExpr_Error (ColorExpr_Parser *ps, char *msg) {
+    if (ps->error == NULL) {
+        ps->error    = msg;
+        ps->errorPos = ps->pos;
+    }
+    return &ps->node[0];
+}
+
+//
+// Erzeugt einen neuen Knoten. Sind alle Argumente konstant, wird die
+// Operation gleich ausgefuehrt und eine Konstante zurueckgegeben.
+//
+static ColorExpr_Node *ColorExpr_NewNode (ColorExpr_Parser *ps, int op,
+        ColorExpr_Node *a, ColorExpr_Node *b, ColorExpr_Node *c) {
+    ColorExpr_Node *nd;
+    float va, vb, vc;
+
+    if (ps->numNodes >= COLOREXPR_MAX_NODES) {
+        return ColorExpr_Error (ps, "expression too long");
+    }
+    nd = &ps->node[ps->numNodes++];
+    nd->op     = op;
+    nd->value  = 0.0;
+    nd->var    = 0;
+    nd->arg[0] = a;
+    nd->arg[1] = b;
+    nd->arg[2] = c;
+    if ((op == EXPR_CONST) || (op == EXPR_VAR) || (op == EXPR_CURVE)) {
+        return nd;
+    }
+    if (((a != NULL) && (a->op != EXPR_CONST))
+            || ((b != NULL) && (b->op != EXPR_CONST))
+            || ((c != NULL) && (c->op != EXPR_CONST))) {
+        return nd;
+    }
+    va = a->value;
+    vb = (b != NULL) ? b->value : 0.0;
+    vc = (c != NULL) ? c->value : 0.0;
+    ColorExpr_Exec (op, &nd->value, 1, &va, 0, &vb, 0, &vc, 0, NULL, 0);
+    nd->op     = EXPR_CONST;
+    nd->arg[0] = nd->arg[1] = nd->arg[2] = NULL;
+    return nd;
+}
+
+static ColorExpr_Node *ColorExpr_Const (ColorExpr_Parser *ps, float value) {
+    ColorExpr_Node *nd;
+
+    nd = ColorExpr_NewNode (ps, EXPR_CONST, NULL, NULL, NULL);
+    nd->value = value;
+    return nd;
+}
+
+static void ColorExpr_SkipSpace (ColorExpr_Parser *ps) {
+    while (isspace ((unsigned char) ps->text[ps->pos])) {
+        ps->pos++;
+    }
+}
+
+//
+// Liefert 1 und ueberspringt 'token', falls der Text an der aktuellen
+// Position damit beginnt.
+//
+static int ColorExpr_Accept (ColorExpr_Parser *ps, char *token) {
+    int len;
+
+    ColorExpr_SkipSpace (ps);
+    len = strlen (token);
+    if (strncmp (ps->text + ps->pos, token, len) != 0) {
+        return 0;
+    }
+    // '<' darf nicht den Anfang von '<=' schlucken (usw.).
+    if ((len == 1) && (strchr ("<>!", token[0]) != NULL)
+            && (ps->text[ps->pos+1] == '=')) {
+        return 0;
+    }
+    ps->pos += len;
+    return 1;
+}
+
+static ColorExpr_Node *ColorExpr_ParseExpr (ColorExpr_Parser *ps);
+
+static ColorExpr_Node *ColorExpr_ParsePrimary (ColorExpr_Parser *ps) {
+    ColorExpr_Node *nd, *arg[2];
+    char name[16], *end;
+    float value;
+    size_t len;
+    int i;
+
+    ColorExpr_SkipSpace (ps);
+    if (ColorExpr_Accept (ps, "(")) {
+        nd = ColorExpr_ParseExpr (ps);
+        if (! ColorExpr_Accept (ps, ")")) {
+            return ColorExpr_Error (ps, "')' expected");
+        }
+        return nd;
+    }
+    if (isdigit ((unsigned char) ps->text[ps->pos])
+            || (ps->text[ps->pos] == '.')) {
+        value = strtof (ps->text + ps->pos, &end);
+        ps->pos = end - ps->text;
+        return ColorExpr_Const (ps, value);
+    }
+    if (! isalpha ((unsigned char) ps->text[ps->pos])) {
+        return ColorExpr_Error (ps, "unexpected character");
+    }
+    for (len=0; isalnum ((unsigned char) ps->text[ps->pos+len]); len++) {
+        if (len < sizeof (name)-1) {
+            name[len] = ps->text[ps->pos+len];
+        }
+    }
+    name[(len < sizeof (name)) ? len : sizeof (name)-1] = '\0';
+    ps->pos += len;
+
+    if (strcmp (name, "x") == 0) {
+        nd = ColorExpr_NewNode (ps, EXPR_VAR, NULL, NULL, NULL);
+        nd->var = 0;
+        return nd;
+    }
+    if (strcmp (name, "y") == 0) {
+        nd = ColorExpr_NewNode (ps, EXPR_VAR, NULL, NULL, NULL);
+        nd->var = -1 - EXPR_REG_Y;
+        return nd;
+    }
+    if (strcmp (name, "step") == 0) {
+        nd = ColorExpr_NewNode (ps, EXPR_VAR, NULL, NULL, NULL);
+        nd->var = -1 - EXPR_REG_STEP;
+        return nd;
+    }
+    if (strcmp (name, "t") == 0) {
+        nd = ColorExpr_NewNode (ps, EXPR_VAR, NULL, NULL, NULL);
+        nd->var = -1 - EXPR_REG_T;
+        return nd;
+    }
+    if (strcmp (name, "size") == 0) {
+        return ColorExpr_Const (ps, ps->cg->size);
+    }
+    if (strcmp (name, "period") == 0) {
+        return ColorExpr_Const (ps, COLORGRID_PERIOD(ps->cg));
+    }
+    if (strcmp (name, "pi") == 0) {
+        return ColorExpr_Const (ps, M_PI);
+    }
+    for (i=0; ColorExpr_FuncTable[i].name != NULL; i++) {
+        if (strcmp (name, ColorExpr_FuncTable[i].name) == 0) {
+            break;
+        }
+    }
+    if (ColorExpr_FuncTable[i].name == NULL) {
+        return ColorExpr_Error (ps, "unknown name");
+    }
+    if (! ColorExpr_Accept (ps, "(")) {
+        return ColorExpr_Error (ps, "'(' expected");
+    }
+    arg[0] = ColorExpr_ParseExpr (ps);
+    arg[1] = NULL;
+    if (ColorExpr_FuncTable[i].numArgs == 2) {
+        if (! ColorExpr_Accept (ps, ",")) {
+            return ColorExpr_Error (ps, "',' expected");
+        }
+        arg[1] = ColorExpr_ParseExpr (ps);
+    }
+    if (! ColorExpr_Accept (ps, ")")) {
+        return ColorExpr_Error (ps, "')' expected");
+    }
+    return ColorExpr_NewNode (ps, ColorExpr_FuncTable[i].op, arg[0], arg[1],
+            NULL);
+}
+
+static ColorExpr_Node *ColorExpr_ParseUnary (ColorExpr_Parser *ps) {
+    if (ColorExpr_Accept (ps, "-")) {
+        return ColorExpr_NewNode (ps, EXPR_NEG, ColorExpr_ParseUnary (ps),
+                NULL, NULL);
+    }
+    if (ColorExpr_Accept (ps, "!")) {
+        return ColorExpr_NewNode (ps, EXPR_NOT, ColorExpr_ParseUnary (ps),
+                NULL, NULL);
+    }
+    return ColorExpr_ParsePrimary (ps);
+}
+
+static ColorExpr_Node *ColorExpr_ParseMul (ColorExpr_Parser *ps) {
+    ColorExpr_Node *nd;
+
+    nd = ColorExpr_ParseUnary (ps);
+    while (1) {
+        if (ColorExpr_Accept (ps, "*")) {
+            nd = ColorExpr_NewNode (ps, EXPR_MUL, nd,
+                    ColorExpr_ParseUnary (ps), NULL);
+        } else if (ColorExpr_Accept (ps, "/")) {
+            nd = ColorExpr_NewNode (ps, EXPR_DIV, nd,
+                    ColorExpr_ParseUnary (ps), NULL);
+        } else if (ColorExpr_Accept (ps, "%")) {
+            nd = ColorExpr_NewNode (ps, EXPR_MOD, nd,
+                    ColorExpr_ParseUnary (ps), NULL);
+        } else {
+            return nd;
+        }
+    }
+}
+
+static ColorExpr_Node *ColorExpr_ParseAdd (ColorExpr_Parser *ps) {
+    ColorExpr_Node *nd;
+
+    nd = ColorExpr_ParseMul (ps);
+    while (1) {
+        if (ColorExpr_Accept (ps, "+")) {
+            nd = ColorExpr_NewNode (ps, EXPR_ADD, nd,
+                    ColorExpr_ParseMul (ps), NULL);
+        } else if (ColorExpr_Accept (ps, "-")) {
+            nd = ColorExpr_NewNode (ps, EXPR_SUB, nd,
+                    ColorExpr_ParseMul (ps), NULL);
+        } else {
+            return nd;
+        }
+    }
+}
+
+static ColorExpr_Node *ColorExpr_ParseCompare (ColorExpr_Parser *ps) {
+    static struct {
+        char *token;
+        int op;
+    } cmp[] = {
+        { "<=", EXPR_LE }, { ">=", EXPR_GE }, { "==", EXPR_EQ },
+        { "!=", EXPR_NE }, { "<",  EXPR_LT }, { ">",  EXPR_GT },
+        { NULL, 0 }
+    };
+    ColorExpr_Node *nd;
+    int i;
+
+    nd = ColorExpr_ParseAdd (ps);
+    for (i=0; cmp[i].token != NULL; i++) {
+        if (ColorExpr_Accept (ps, cmp[i].token)) {
+            return ColorExpr_NewNode (ps, cmp[i].op, nd,
+                    ColorExpr_ParseAdd (ps), NULL);
+        }
+    }
+    return nd;
+}
+
+static ColorExpr_Node *ColorExpr_ParseAnd (ColorExpr_Parser *ps) {
+    ColorExpr_Node *nd;
+
+    nd = ColorExpr_ParseCompare (ps);
+    while (ColorExpr_Accept (ps, "&&")) {
+        nd = ColorExpr_NewNode (ps, EXPR_AND, nd,
+                ColorExpr_ParseCompare (ps), NULL);
+    }
+    return nd;
+}
+
+static ColorExpr_Node *ColorExpr_ParseOr (ColorExpr_Parser *ps) {
+    ColorExpr_Node *nd;
+
+    nd = ColorExpr_ParseAnd (ps);
+    while (ColorExpr_Accept (ps, "||")) {
+        nd = ColorExpr_NewNode (ps, EXPR_OR, nd, ColorExpr_ParseAnd (ps),
+                NULL);
+    }
+    return nd;
+}
+
+static ColorExpr_Node *ColorExpr_ParseExpr (ColorExpr_Parser *ps) {
+    ColorExpr_Node *nd, *a, *b;
+
+    nd = ColorExpr_ParseOr (ps);
+    if (ColorExpr_Accept (ps, "?")) {
+        a = ColorExpr_ParseExpr (ps);
+        if (! ColorExpr_Accept (ps, ":")) {
+            return ColorExpr_Error (ps, "':' expected");
+        }
+        b = ColorExpr_ParseExpr (ps);
+        nd = ColorExpr_NewNode (ps, EXPR_SEL, nd, a, b);
+    }
+    return nd;
+}
+
+//
+// Registerverwaltung fuer die Uebersetzung: 'used' markiert belegte
+// Register, Eingaben und Konstanten werden nie freigegeben. Konstanten
+// werden nur einmal vor der Auswertung geladen und duerfen daher kein
+// Register erhalten, das vorher schon als Zwischenresultat diente
+// ('ever').
+//
+typedef struct ColorExpr_Regs {
+    char sUsed[COLOREXPR_MAX_REGS], vUsed[COLOREXPR_MAX_REGS];
+    char sTemp[COLOREXPR_MAX_REGS], vTemp[COLOREXPR_MAX_REGS];
+    char sEver[COLOREXPR_MAX_REGS], vEver[COLOREXPR_MAX_REGS];
+    int numScalars, numVectors;
+} ColorExpr_Regs;
+
+static int ColorExpr_AllocReg (ColorExpr_Regs *rg, int vector, int temp) {
+    char *used, *isTemp, *ever;
+    int *num, i;
+
+    used   = vector ? rg->vUsed : rg->sUsed;
+    isTemp = vector ? rg->vTemp : rg->sTemp;
+    ever   = vector ? rg->vEver : rg->sEver;
+    num    = vector ? &rg->numVectors : &rg->numScalars;
+    for (i=0; (i<COLOREXPR_MAX_REGS) && (used[i] || (! temp && ever[i]));
+            i++)
+        ;
+    if (i >= COLOREXPR_MAX_REGS) {
+        return COLOREXPR_MAX_REGS;
+    }
+    used[i]   = 1;
+    isTemp[i] = temp;
+    ever[i]   = 1;
+    if (i >= *num) {
+        *num = i+1;
+    }
+    return vector ? i : -1-i;
+}
+
+static void ColorExpr_FreeReg (ColorExpr_Regs *rg, int reg) {
+    if ((reg >= 0) && rg->vTemp[reg]) {
+        rg->vUsed[reg] = 0;
+    } else if ((reg < 0) && rg->sTemp[-1-reg]) {
+        rg->sUsed[-1-reg] = 0;
+    }
+}
+
+//
+// Erzeugt die Befehle fuer den Baum 'nd' und liefert das Register mit dem
+// Resultat (oder COLOREXPR_MAX_REGS, falls die Register nicht reichen).
+//
+static int ColorExpr_Gen (ColorExpr ex, ColorExpr_Regs *rg,
+        ColorExpr_Node *nd) {
+    ColorExpr_Instr *in;
+    int i, reg, arg[3], vector;
+
+    if (nd->op == EXPR_VAR) {
+        return nd->var;
+    }
+    if (nd->op == EXPR_CONST) {
+        reg = ColorExpr_AllocReg (rg, 0, 0);
+        if (reg == COLOREXPR_MAX_REGS) {
+            return reg;
+        }
+        ex->scalarInit[-1-reg] = nd->value;
+        return reg;
+    }
+    vector = 0;
+    for (i=0; i<3; i++) {
+        arg[i] = (nd->arg[i] != NULL) ? ColorExpr_Gen (ex, rg, nd->arg[i])
+                : arg[0];
+        if (arg[i] == COLOREXPR_MAX_REGS) {
+            return arg[i];
+        }
+        vector |= (arg[i] >= 0);
+    }
+    for (i=0; i<3; i++) {
+        if (nd->arg[i] != NULL) {
+            ColorExpr_FreeReg (rg, arg[i]);
+        }
+    }
+    reg = ColorExpr_AllocReg (rg, vector, 1);
+    if (reg == COLOREXPR_MAX_REGS) {
+        return reg;
+    }
+    in = &ex->instr[ex->numInstr++];
+    in->op  = nd->op;
+    in->dst = reg;
+    in->a   = arg[0];
+    in->b   = arg[1];
+    in->c   = arg[2];
+    return reg;
+}
+
+static void ColorExpr_Free (ColorExpr ex) {
+    free (ex->instr);
+    free (ex->scalarInit);
+    free (ex->xs);
+    free (ex);
+}
+
+//
+// Uebersetzt 'text' fuer die Grid 'cg'. Bei einem Fehler wird eine Meldung
+// ausgegeben und NULL geliefert.
+//
+static ColorExpr ColorExpr_Compile (ColorGrid cg, char *text) {
+    ColorExpr_Parser *ps;
+    ColorExpr_Regs rg;
+    ColorExpr_Node *root;
+    ColorExpr ex;
+    int i;
+
+    ps = malloc (sizeof (ColorExpr_Parser));
+    ps->text     = text;
+    ps->pos      = 0;
+    ps->error    = NULL;
+    ps->numNodes = 0;
+    ps->cg       = cg;
+    ColorExpr_Const (ps, 0.0);
+    root = ColorExpr_ParseExpr (ps);
+    ColorExpr_SkipSpace (ps);
+    if (ps->text[ps->pos] != '\0') {
+        ColorExpr_Error (ps, "unexpected character");
+    }
+    if (ps->error != NULL) {
+        fprintf (stderr, "ERROR: %s at position %d in expression '%s'!\n",
+                ps->error, ps->errorPos, text);
+        free (ps);
+        return NULL;
+    }
+
+    ex = malloc (sizeof (struct ColorExpr));
+    ex->size       = cg->size;
+    ex->period     = COLORGRID_PERIOD(cg);
+    ex->numInstr   = 0;
+    ex->instr      = calloc (ps->numNodes, sizeof (ColorExpr_Instr));
+    ex->scalarInit = calloc (COLOREXPR_MAX_REGS, sizeof (float));
+    ex->xs         = calloc (cg->size, sizeof (float));
+    for (i=0; i<cg->size; i++) {
+        ex->xs[i] = i;
+    }
+    memset (&rg, 0, sizeof (rg));
+    for (i=0; i<EXPR_NUM_INPUTS; i++) {
+        ColorExpr_AllocReg (&rg, 0, 0);
+    }
+    ColorExpr_AllocReg (&rg, 1, 0);
+    ex->result = ColorExpr_Gen (ex, &rg, root);
+    ex->numScalars = rg.numScalars;
+    ex->numVectors = rg.numVectors;
+    free (ps);
+    if (ex->result == COLOREXPR_MAX_REGS) {
+        fprintf (stderr, "ERROR: expression '%s' is too complex!\n", text);
+        ColorExpr_Free (ex);
+        return NULL;
+    }
+    return ex;
+}
+
+//
+// Berechnet die Zeile 'y' beim Schritt 'step' nach 'row'. Die Register
+// liegen auf dem Stack, damit mehrere Threads denselben Ausdruck
+// gleichzeitig auswerten koennen.
+//
+static void ColorExpr_EvalRow (ColorExpr ex, ColorGrid cg, int color, int y,
+        int step, unsigned char *row) {
+    float s[ex->numScalars], v[ex->numVectors * ex->size];
+    float *reg[3], *d, r;
+    unsigned char *table;
+    ColorExpr_Instr *in;
+    int i, k, n, op, stride[3];
+
+    memcpy (s, ex->scalarInit, ex->numScalars * sizeof (float));
+    memcpy (v, ex->xs, ex->size * sizeof (float));
+    s[EXPR_REG_Y]    = y;
+    s[EXPR_REG_STEP] = step;
+    s[EXPR_REG_T]    = (float) step / ex->period;
+    table = __atomic_load_n (&cg->matrix[color], __ATOMIC_ACQUIRE);
+
+    for (i=0; i<ex->numInstr; i++) {
+        in = &ex->instr[i];
+        op = in->op;
+        for (k=0; k<3; k++) {
+            n = (k == 0) ? in->a : (k == 1) ? in->b : in->c;
+            reg[k]    = (n >= 0) ? v + n * ex->size : s + (-1-n);
+            stride[k] = (n >= 0);
+        }
+        if (in->dst >= 0) {
+            d = v + in->dst * ex->size;
+            n = ex->size;
+        } else {
+            d = s + (-1-in->dst);
+            n = 1;
+        }
+        ColorExpr_Exec (op, d, n, reg[0], stride[0], reg[1], stride[1],
+                reg[2], stride[2], table, ex->period);
+    }
+
+    if (ex->result >= 0) {
+        d = v + ex->result * ex->size;
+        k = 1;
+    } else {
+        d = s + (-1-ex->result);
+        k = 0;
+    }
+    for (i=0; i<ex->size; i++) {
+        r = d[i*k];
+        row[i] = (r >= 255.0) ? 255 : (r > 0.0) ? (unsigned char) r : 0;
+    }
+}
+
+//
+// Berechnet die Zeile 'y' mit der Farbfunktion 'cf', unabhaengig von
+// deren Art (ausser Offset-Tabellen).
+//
+static void ColorGrid_FuncRow (ColorGrid cg, ColorFuncType *cf, int color,
+        int y, int step, unsigned char *row) {
+    if (cf->rowFunc != NULL) {
+        cf->rowFunc (cg, color, y, step, row);
+    } else if (cf->expr != NULL) {
+        ColorExpr_EvalRow (cf->expr, cg, color, y, step, row);
+    } else {
+        ColorGrid_PixelRow (cg, cf->func, color, y, step, row);
+    }
+}
+
+//
+// Berechnet die Zeilen 'y0' bis 'y1'-1 der Farbe 'color' beim Schritt 'step'
+// nach 'plane'. Bei Funktionen mit Offset-Tabelle ist dies ein
+// einfaches Auslesen aus der Farbtabelle ohne Funktionsaufrufe und
+// Verzweigungen, Zeilenfunktionen werden einmal pro Zeile aufgerufen.
+// Symmetrische Funktionen werden hier nicht beruecksichtigt.
+//
+static void ColorGrid_CalcRows (ColorGrid cg, int color, int step,
+        unsigned char *plane, int y0, int y1) {
+    ColorFuncType *cf;
+    unsigned char *table;
+    int *offset;
+    int p, y;
+
+    cf = &cg->colorFuncArray[cg->colorFunc[color]];
+    if (cf->offset != NULL) {
+        table  = __atomic_load_n (&cg->matrix[color], __ATOMIC_ACQUIRE)
+                + step;
+        offset = cf->offset;
+        for (p=y0*cg->size; p<y1*cg->size; p++) {
+            plane[p] = table[offset[p]];
+        }
+    } else {
+        for (y=y0; y<y1; y++) {
+            ColorGrid_FuncRow (cg, cf, color, y, step, plane + y * cg->size);
+        }
+    }
+}
+
+//
+// Liefert 1, falls die Ebene der Farbe 'color' zeilenweise (und damit auf
+// mehrere Threads verteilt) berechnet werden kann. Bei symmetrischen
+// Funktionen ohne Offset-Tabelle haengen die Zeilen voneinander ab.
+//
+static int ColorGrid_RowSplit (ColorGrid cg, int color) {
+    ColorFuncType *cf;
+
+    cf = &cg->colorFuncArray[cg->colorFunc[color]];
+    return (cf->symmetry == SYMMETRY_NONE) || (cf->offset != NULL);
+}
+
+//
+// Berechnet die Werte der Farbe 'color' beim Schritt 'step' fuer alle Pixel
+// nach 'plane'.
+//
+static void ColorGrid_CalcPlane (ColorGrid cg, int color, int step,
+        unsigned char *plane) {
+    ColorFuncType *cf;
+    int *fund, *copy;
+    int i, p, y, rows;
+
+    cf = &cg->colorFuncArray[cg->colorFunc[color]];
+    if ((cf->symmetry != SYMMETRY_NONE) && (cf->offset == NULL)) {
+        // Nur der Grundbereich wird berechnet, der Rest kopiert. Zeilen-
+        // funktionen liefern immer ganze Zeilen, profitieren also nur von
+        // der Spiegelung an der Y-Achse (ebenso Ausdruecke).
+        fund = cg->symFund[cf->symmetry];
+        copy = cg->symCopy[cf->symmetry];
+        if (cf->func == NULL) {
+            rows = (cf->symmetry == SYMMETRY_MIRROR_X) ? cg->size
+                    : (cg->size+1) / 2;
+            for (y=0; y<rows; y++) {
+                ColorGrid_FuncRow (cg, cf, color, y, step,
+                        plane + y * cg->size);
+            }
+            for (; y<cg->size; y++) {
+                memcpy (plane + y * cg->size,
+                        plane + (cg->size-1-y) * cg->size, cg->size);
+            }
+            return;
         }
-        cg->fadeStep[i] = 0;
-        cg->fadeIncr[i] = 0;
+        for (i=0; i<cg->symNumFund[cf->symmetry]; i++) {
+            p = fund[i];
+            plane[p] = cf->func (cg, color, p % cg->size, p / cg->size, step);
+        }
+        for (i=0; i<cg->symNumCopy[cf->symmetry]; i++) {
+            plane[copy[2*i]] = plane[copy[2*i+1]];
+        }
+        return;
     }
-    cg->numColorFuncs = 0;
-    cg->sem = Semaphore_Init (1);
-
-    return cg;
+    ColorGrid_CalcRows (cg, color, step, plane, 0, cg->size);
 }
 
-void ColorGrid_Free (ColorGrid cg) {
-    int i;
-
-    assert (cg != NULL);
-
-    for (i=0; i<3; i++) {
-        free (cg->matrix[i]);
+//
+// Berechnet die Zeilen 'y0' bis 'y1'-1, bzw. die ganze Ebene, falls sich
+// die Farbfunktion nicht zeilenweise aufteilen laesst.
+//
+static void ColorGrid_CalcPart (ColorGrid cg, int color, int step,
+        unsigned char *plane, int y0, int y1) {
+    if (ColorGrid_RowSplit (cg, color)) {
+        ColorGrid_CalcRows (cg, color, step, plane, y0, y1);
+    } else {
+        ColorGrid_CalcPlane (cg, color, step, plane);
     }
-    LedGrid_Free (cg->lg);
-    free (cg);
 }
 
-void ColorGrid_Recalc (ColorGrid cg, int color, \
-        double max, double exp) {
-    int i, j;
-    double x;
-
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
-    assert ((max > 0.0) && (exp >= 1.0));
-
-    cg->maxValue[color] = max;
-    cg->expValue[color] = exp;
-
-    int f (double x, double max, double e) {
-        double p = 256.0 / pow (e, 8.0);
-        double v;
+//
+// Mischt die Ebenen 'a' und 'b' im Verhaeltnis 'frac' (0..255) nach 'dst'.
+//
+static void ColorGrid_Blend (unsigned char *dst, unsigned char *a,
+        unsigned char *b, int frac, int n) {
+    int p;
 
-        x = x * (cg->size-1.0);
-        v = p * floor (pow (2.0, (x-1.0)));
-        return (v>255) ? 255 : v;
+    for (p=0; p<n; p++) {
+        dst[p] = a[p] + (((b[p] - a[p]) * frac) >> 8);
     }
+}
 
-    for (i=0, j=0; i<(cg->size-1)*cg->numFadeSteps; i++, j++) {
-        x = (double) (j) / (double) ((cg->size-1) * cg->numFadeSteps);
-        cg->matrix[color][i] = f (x, max, exp);
+//
+// Berechnet die Ebene der Farbe 'color' fuer die Position 'pos' (16.16),
+// und zwar die Zeilen 'y0' bis 'y1'-1 (siehe 'ColorGrid_CalcPart').
+// Offset-Tabellen werden direkt interpoliert ausgelesen, bei allen
+// anderen Funktionen werden die Ebenen der beiden benachbarten Schritte
+// berechnet und gemischt.
+//
+static void ColorGrid_CalcPlanePos (ColorGrid cg, int color, int64_t pos,
+        unsigned char *plane, int y0, int y1) {
+    ColorFuncType *cf;
+    unsigned char *table;
+    int *offset;
+    int p, step, frac, a;
+
+    step = (int) (pos >> 16);
+    frac = (int) ((pos >> 8) & 0xFF);
+    if (frac == 0) {
+        ColorGrid_CalcPart (cg, color, step, plane, y0, y1);
+        return;
     }
-
-    for (j=(cg->size-1)*cg->numFadeSteps; j>0; i++, j--) {
-        x = (double) (j) / (double) ((cg->size-1) * cg->numFadeSteps);
-        cg->matrix[color][i] = f (x, max, exp);
+    cf = &cg->colorFuncArray[cg->colorFunc[color]];
+    if (cf->offset != NULL) {
+        table  = __atomic_load_n (&cg->matrix[color], __ATOMIC_ACQUIRE)
+                + step;
+        offset = cf->offset;
+        for (p=y0*cg->size; p<y1*cg->size; p++) {
+            a = table[offset[p]];
+            plane[p] = a + (((table[offset[p]+1] - a) * frac) >> 8);
+        }
+    } else {
+        if (! ColorGrid_RowSplit (cg, color)) {
+            y0 = 0;
+            y1 = cg->size;
+        }
+        ColorGrid_CalcPart (cg, color, step, plane, y0, y1);
+        ColorGrid_CalcPart (cg, color, (step+1) % COLORGRID_PERIOD(cg),
+                cg->planeNext[color], y0, y1);
+        ColorGrid_Blend (plane + y0 * cg->size, plane + y0 * cg->size,
+                cg->planeNext[color] + y0 * cg->size, frac,
+                (y1-y0) * cg->size);
     }
 }
 
-void ColorGrid_SetGamma (ColorGrid cg, float gammaValue) {
-    assert (cg != NULL);
+//
+// Zwischenspeicher fuer ganze Perioden --
+//
+// Die Animationen einer ColorGrid sind periodisch: der Wert eines Kanals
+// haengt nur von Farbfunktion, Farbtabelle und Schritt ab, und es gibt
+// COLORGRID_PERIOD verschiedene Schritte. Ist der Zwischenspeicher
+// eingeschaltet, berechnet ein Thread im Hintergrund fuer jeden Kanal alle
+// Schritte einer Periode. Bis ein Kanal fertig ist, wird er wie bisher
+// direkt berechnet. Aendern Farbfunktion oder Farbtabelle, wird der Kanal
+// ungueltig und neu berechnet; Aenderungen von Schritt und Inkrement
+// brauchen keine Neuberechnung, da alle Schritte vorhanden sind.
+//
+// 'cacheLock' schuetzt 'cacheValid' und 'cacheGen'. Der Thread schreibt nur
+// in ungueltige Kanaele, 'ColorGrid_SetColors' liest nur gueltige, und
+// zwar waehrend es 'cacheLock' haelt.
+//
+static void *ColorGrid_CacheThread (void *arg) {
+    ColorGrid cg = (ColorGrid) arg;
+    int c, s, gen, n;
 
-    LedGrid_SetGamma (cg->lg, gammaValue);
+    n = cg->size * cg->size;
+    while (1) {
+        Semaphore_P (cg->cacheWake);
+        while (1) {
+            Semaphore_P (cg->cacheLock);
+            if (cg->cacheStop) {
+                Semaphore_V (cg->cacheLock);
+                return NULL;
+            }
+            for (c=0; (c<3) && cg->cacheValid[c]; c++)
+                ;
+            if (c == 3) {
+                Semaphore_V (cg->cacheLock);
+                break;
+            }
+            gen = cg->cacheGen[c];
+            Semaphore_V (cg->cacheLock);
+
+            for (s=0; s<COLORGRID_PERIOD(cg); s++) {
+                ColorGrid_CalcPlane (cg, c, s, cg->cache[c] + s * n);
+            }
+
+            Semaphore_P (cg->cacheLock);
+            if (cg->cacheGen[c] == gen) {
+                cg->cacheValid[c] = 1;
+            }
+            Semaphore_V (cg->cacheLock);
+        }
+    }
+    return NULL;
 }
 
-void ColorGrid_WriteColorFile (ColorGrid cg, char *fileName) {
-    FILE *fd;
-    int i, j;
+void ColorGrid_SetCache (ColorGrid cg, int enable) {
+    int i;
 
     assert (cg != NULL);
-    assert (fileName != NULL);
 
-    fd = fopen (fileName, "w");
-    if (fd == NULL) {
-        fprintf (stderr, "ERROR: couldn't open file '%s'!\n", fileName);
-        exit (1);
+    if ((enable != 0) == cg->cacheOn) {
+        return;
     }
-    fprintf (fd, "%d %d\n", cg->size, cg->numFadeSteps);
-    for (i=0; i<3; i++) {
-        fprintf (fd, "\n");
-        for (j=0; j<2*(cg->size-1)*cg->numFadeSteps; j++) {
-            fprintf (fd, "%3d ", cg->matrix[i][j]);
-            if ((j+1) % cg->numFadeSteps == 0) {
-                fprintf (fd, "\n");
-            }
+    if (enable) {
+        for (i=0; i<3; i++) {
+            cg->cache[i] = malloc (COLORGRID_PERIOD(cg) * cg->size * cg->size);
+            cg->cacheValid[i] = 0;
+            cg->cacheGen[i]   = 0;
         }
-        fprintf (fd, "\n");
+        cg->cacheStop = 0;
+        cg->cacheLock = Semaphore_Init (1);
+        cg->cacheWake = Semaphore_Init (1);
+        cg->cacheOn   = 1;
+        pthread_create (&cg->cacheThread, NULL, ColorGrid_CacheThread, cg);
+    } else {
+        Semaphore_P (cg->cacheLock);
+        cg->cacheStop = 1;
+        Semaphore_V (cg->cacheLock);
+        Semaphore_V (cg->cacheWake);
+        pthread_join (cg->cacheThread, NULL);
+        cg->cacheOn = 0;
+        for (i=0; i<3; i++) {
+            free (cg->cache[i]);
+        }
+        Semaphore_Free (cg->cacheLock);
+        Semaphore_Free (cg->cacheWake);
     }
-    fclose (fd);
 }
 
-unsigned char ColorGrid_GetColor (ColorGrid cg, int color, int step) {
+//
+// Liefert 1, falls der Kanal 'color' aus dem Zwischenspeicher kommt.
+//
+int ColorGrid_IsCached (ColorGrid cg, int color) {
+    int valid;
+
     assert (cg != NULL);
     assert ((color >= 0) && (color <= 2));
-    assert (step >= 0);
 
-    return cg->matrix[color][step%(2*(cg->size-1)*cg->numFadeSteps)];
+    if (! cg->cacheOn) {
+        return 0;
+    }
+    Semaphore_P (cg->cacheLock);
+    valid = cg->cacheValid[color];
+    Semaphore_V (cg->cacheLock);
+
+    return valid;
 }
 
-void ColorGrid_Fade (ColorGrid cg, int color) {
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
+static void ColorGrid_InvalidateCache (ColorGrid cg, int color) {
+    cg->planeValid[color] = 0;
+    if (! cg->cacheOn) {
+        return;
+    }
+    Semaphore_P (cg->cacheLock);
+    cg->cacheGen[color]++;
+    cg->cacheValid[color] = 0;
+    Semaphore_V (cg->cacheLock);
+    Semaphore_V (cg->cacheWake);
+}
+
+//
+// Schreibt 'n' Pixel aus den drei Farbebenen verschraenkt nach 'dst'. Mit
+// ARM NEON werden je 16 Pixel mit einem 'vst3q_u8' geschrieben; der Rest
+// (und ohne NEON alles) pixelweise.
+//
+static void ColorGrid_Interleave (unsigned char *dst, unsigned char *red,
+        unsigned char *green, unsigned char *blue, int n) {
+    int i;
+#ifdef __ARM_NEON
+    uint8x16x3_t v;
+#endif
 
-    cg->fadeStep[color] += cg->fadeIncr[color];
-    if (cg->fadeStep[color] < 0) {
-        cg->fadeStep[color] += 2 * (cg->size-1) * cg->numFadeSteps;
+    i = 0;
+#ifdef __ARM_NEON
+    for (; i+16<=n; i+=16) {
+        v.val[RED]   = vld1q_u8 (red + i);
+        v.val[GREEN] = vld1q_u8 (green + i);
+        v.val[BLUE]  = vld1q_u8 (blue + i);
+        vst3q_u8 (dst + 3*i, v);
     }
-    if (cg->fadeStep[color] >= (2 * (cg->size-1) * cg->numFadeSteps)) {
-        cg->fadeStep[color] -= 2 * (cg->size-1) * cg->numFadeSteps;
+#endif
+    for (; i<n; i++) {
+        dst[3*i + RED]   = red[i];
+        dst[3*i + GREEN] = green[i];
+        dst[3*i + BLUE]  = blue[i];
     }
 }
 
-void ColorGrid_SetFadeIncr (ColorGrid cg, int color, int incr) {
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
+//
+// Aufgaben pro Kanal fuer 'ColorGrid_Work'.
+//
+enum {
+    COLORGRID_JOB_NONE,
+    COLORGRID_JOB_CALC,
+    COLORGRID_JOB_BLEND
+};
 
-    cg->fadeIncr[color] = incr;
-}
+//
+// Mindestanzahl Zeilen pro Thread. Bei kleineren Grids kosten die
+// Barrieren mehr als die Arbeit; 'ColorGrid_SetColors' rechnet dann das
+// ganze Bild im aufrufenden Thread.
+//
+#define COLORGRID_MINROWS 8
 
-int  ColorGrid_GetFadeIncr (ColorGrid cg, int color) {
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
+//
+// Anteil des Threads 'k' (von 'num') an einem Bild: zuerst werden die
+// Zeilen y0 bis y1-1 aller neu zu berechnenden Ebenen bestimmt (nicht
+// aufteilbare Ebenen ganz von einem Thread), danach werden dieselben
+// Zeilen ins Bild geschrieben. Eine Barriere dazwischen ist nur noetig,
+// wenn eine Ebene ganz von einem Thread berechnet wird ('jobSync').
+//
+static void ColorGrid_Work (ColorGrid cg, int k, int num) {
+    LedImage *im;
+    unsigned char *row, *plane[3];
+    int c, y, p, n, y0, y1, img, step, ox;
+
+    n  = cg->size * cg->size;
+    y0 = k * cg->size / num;
+    y1 = (k+1) * cg->size / num;
+    for (c=0; c<3; c++) {
+        plane[c] = cg->plane[c];
+        switch (cg->jobMode[c]) {
+            case COLORGRID_JOB_CALC:
+                if (ColorGrid_RowSplit (cg, c)) {
+                    ColorGrid_CalcPlanePos (cg, c, cg->jobPos[c],
+                            cg->plane[c], y0, y1);
+                } else if ((c % num) == k) {
+                    ColorGrid_CalcPlanePos (cg, c, cg->jobPos[c],
+                            cg->plane[c], 0, cg->size);
+                }
+                break;
+            case COLORGRID_JOB_BLEND:
+                step = (int) (cg->jobPos[c] >> 16);
+                p    = y0 * cg->size;
+                ColorGrid_Blend (cg->plane[c] + p, cg->cache[c] + step * n + p,
+                        cg->cache[c] + ((step+1) % COLORGRID_PERIOD(cg)) * n
+                        + p, (cg->jobPos[c] >> 8) & 0xFF, (y1-y0) * cg->size);
+                break;
+        }
+        if (cg->cacheOn && cg->cacheValid[c]
+                && ((cg->jobPos[c] & 0xFF00) == 0)) {
+            plane[c] = cg->cache[c] + (cg->jobPos[c] >> 16) * n;
+        }
+    }
+    if ((num > 1) && cg->jobSync) {
+        pthread_barrier_wait (&cg->poolBarrier);
+    }
 
-    return cg->fadeIncr[color];
+    img = LEDGRID_DRAWIMAGE(cg->lg);
+    im  = &cg->lg->image[img];
+    ox  = im->originX;
+    for (y=y0, p=y0*cg->size; y<y1; y++, p+=cg->size) {
+        row = cg->lg->field[img][(y + im->originY) % im->sizeY];
+        ColorGrid_Interleave (row + 3*ox, plane[0] + p, plane[1] + p,
+                plane[2] + p, cg->size - ox);
+        ColorGrid_Interleave (row, plane[0] + p + cg->size - ox,
+                plane[1] + p + cg->size - ox, plane[2] + p + cg->size - ox,
+                ox);
+    }
 }
 
-void ColorGrid_IncrFadeIncr (ColorGrid cg, int color, int incrIncr) {
+//
+// Die drei Kanaele werden getrennt in Ebenen berechnet und zeilenweise in
+// das Bild geschrieben. Die Ebene eines Kanals wird nur neu berechnet,
+// wenn sich Position, Farbfunktion oder Farbtabelle geaendert haben; bei
+// einem Inkrement von 0 faellt die Berechnung also ganz weg. Mit
+// 'ColorGrid_SetThreads' wird die Arbeit zeilenweise auf mehrere Threads
+// verteilt, sofern jeder Thread mindestens COLORGRID_MINROWS Zeilen
+// erhaelt; die Funktion kehrt erst zurueck, wenn das ganze Bild fertig
+// ist.
+//
+void ColorGrid_SetColors (ColorGrid cg) {
+    LedImage *im;
+    int c;
+    int64_t pos;
+
     assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
 
-    cg->fadeIncr[color] += incrIncr;
-}
+    im = &cg->lg->image[LEDGRID_DRAWIMAGE(cg->lg)];
+    assert ((im->sizeX == cg->size) && (im->sizeY == cg->size));
 
-void ColorGrid_SetFadeStep (ColorGrid cg, int color, int step) {
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
-    assert (step >= 0);
+    Semaphore_P (cg->sem);
+    if (cg->cacheOn) {
+        Semaphore_P (cg->cacheLock);
+    }
+    cg->jobSync = 0;
+    for (c=0; c<3; c++) {
+        pos = cg->fadePos[c];
+        cg->jobPos[c]  = pos;
+        cg->jobMode[c] = COLORGRID_JOB_NONE;
+        if (cg->cacheOn && cg->cacheValid[c] && ((pos & 0xFF00) == 0)) {
+            continue;
+        }
+        if (! cg->planeValid[c] || (cg->planePos[c] != pos)) {
+            if (cg->cacheOn && cg->cacheValid[c]) {
+                cg->jobMode[c] = COLORGRID_JOB_BLEND;
+            } else {
+                cg->jobMode[c] = COLORGRID_JOB_CALC;
+                if (! ColorGrid_RowSplit (cg, c)) {
+                    cg->jobSync = 1;
+                }
+            }
+            cg->planePos[c]   = pos;
+            cg->planeValid[c] = 1;
+        }
+    }
 
-    cg->fadeStep[color] = step;
-    if (cg->fadeStep[color] >= (2 * (cg->size-1) * cg->numFadeSteps)) {
-        cg->fadeStep[color] -= 2 * (cg->size-1) * cg->numFadeSteps;
+    if ((cg->numThreads > 1)
+            && (cg->size >= COLORGRID_MINROWS * cg->numThreads)) {
+        pthread_barrier_wait (&cg->poolBarrier);
+        ColorGrid_Work (cg, 0, cg->numThreads);
+        pthread_barrier_wait (&cg->poolBarrier);
+    } else {
+        ColorGrid_Work (cg, 0, 1);
+    }
+    if (cg->cacheOn) {
+        Semaphore_V (cg->cacheLock);
     }
+    Semaphore_V (cg->sem);
 }
 
-int  ColorGrid_GetFadeStep (ColorGrid cg, int color) {
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
-
-    return cg->fadeStep[color];
-}
+//
+// Thread-Pool --
+//
+// Die Hilfsthreads werden einmal erzeugt und warten an einer Barriere auf
+// das naechste Bild. Pro Bild gibt es zwei Barrieren (Start und Ende des
+// Bildes), dazu eine dritte nach der Ebenen-Berechnung, falls eine Ebene
+// nicht zeilenweise aufgeteilt werden kann.
+//
+typedef struct ColorGrid_Worker {
+    ColorGrid cg;
+    int index;
+} ColorGrid_Worker;
 
-void ColorGrid_IncrFadeStep (ColorGrid cg, int color, int stepIncr) {
-    assert (cg != NULL);
-    assert ((color >= 0) && (color <= 2));
-    // assert (stepIncr >= 0);
+static void *ColorGrid_PoolThread (void *arg) {
+    ColorGrid_Worker *w;
 
-    cg->fadeStep[color] += stepIncr;
-    if (cg->fadeStep[color] < 0) {
-        cg->fadeStep[color] += 2 * (cg->size-1) * cg->numFadeSteps;
-    } else if (cg->fadeStep[color] >= (2 * (cg->size-1) * cg->numFadeSteps)) {
-        cg->fadeStep[color] -= 2 * (cg->size-1) * cg->numFadeSteps;
+    w = (ColorGrid_Worker *) arg;
+    while (1) {
+        pthread_barrier_wait (&w->cg->poolBarrier);
+        if (w->cg->poolStop) {
+            break;
+        }
+        ColorGrid_Work (w->cg, w->index, w->cg->numThreads);
+        pthread_barrier_wait (&w->cg->poolBarrier);
     }
+    free (w);
+    return NULL;
 }
 
-void ColorGrid_SetColors (ColorGrid cg) {
-    int x, y;
+//
+// Verteilt die Berechnung in 'ColorGrid_SetColors' auf 'numThreads'
+// Threads (inkl. dem aufrufenden). Mit 1 wird der Pool wieder aufgeloest.
+// Farbfunktionen werden dann gleichzeitig aus mehreren Threads aufgerufen
+// und duerfen daher keinen gemeinsamen Zustand veraendern. Aufrufe von
+// 'ColorGrid_SetColors' (und von dieser Funktion) sind ueber 'cg->sem'
+// serialisiert; es arbeitet also immer nur ein Bild auf dem Pool.
+//
+void ColorGrid_SetThreads (ColorGrid cg, int numThreads) {
+    ColorGrid_Worker *w;
+    int i;
 
     assert (cg != NULL);
+    assert (numThreads > 0);
 
-    for (y=0; y<cg->size; y++) {
-        for (x=0; x<cg->size; x++) {
-            LedGrid_SetColor (cg->lg, x, y, \
-                    cg->colorFuncArray[cg->colorFunc[0]].func (cg, 0, \
-                        x, y, cg->fadeStep[0]), \
-                    cg->colorFuncArray[cg->colorFunc[1]].func (cg, 1, \
-                        x, y, cg->fadeStep[1]), \
-                    cg->colorFuncArray[cg->colorFunc[2]].func (cg, 2, \
-                        x, y, cg->fadeStep[2]));
+    Semaphore_P (cg->sem);
+    if (numThreads == cg->numThreads) {
+        Semaphore_V (cg->sem);
+        return;
+    }
+    if (cg->numThreads > 1) {
+        cg->poolStop = 1;
+        pthread_barrier_wait (&cg->poolBarrier);
+        for (i=1; i<cg->numThreads; i++) {
+            pthread_join (cg->poolThread[i], NULL);
+        }
+        pthread_barrier_destroy (&cg->poolBarrier);
+        free (cg->poolThread);
+        cg->poolThread = NULL;
+    }
+    cg->numThreads = numThreads;
+    if (numThreads > 1) {
+        cg->poolStop   = 0;
+        cg->poolThread = calloc (numThreads, sizeof (pthread_t));
+        pthread_barrier_init (&cg->poolBarrier, NULL, numThreads);
+        for (i=1; i<numThreads; i++) {
+            w = malloc (sizeof (ColorGrid_Worker));
+            w->cg    = cg;
+            w->index = i;
+            pthread_create (&cg->poolThread[i], NULL, ColorGrid_PoolThread, w);
         }
     }
+    Semaphore_V (cg->sem);
+}
+
+int ColorGrid_GetThreads (ColorGrid cg) {
+    assert (cg != NULL);
+
+    return cg->numThreads;
 }
 
 void ColorGrid_Show (ColorGrid cg) {
@@ -1333,6 +5543,7 @@ void ColorGrid_SetColorFunc (ColorGrid cg, int color, int funcIndex) {
     assert ((funcIndex >= 0) && (funcIndex < cg->numColorFuncs));
 
     cg->colorFunc[color] = funcIndex;
+    ColorGrid_InvalidateCache (cg, color);
 }
 
 int ColorGrid_GetColorFunc (ColorGrid cg, int color) {
@@ -1359,8 +5570,195 @@ void ColorGrid_AddColorFunc (ColorGrid cg, ColorFunc func, char *name) {
     cg->numColorFuncs++;
     cg->colorFuncArray = realloc (cg->colorFuncArray, \
             cg->numColorFuncs * sizeof (ColorFuncType));
-    cg->colorFuncArray[colorFuncIndex].func = func;
-    cg->colorFuncArray[colorFuncIndex].name = strdup (name);
+    cg->colorFuncArray[colorFuncIndex].func     = func;
+    cg->colorFuncArray[colorFuncIndex].rowFunc  = NULL;
+    cg->colorFuncArray[colorFuncIndex].expr     = NULL;
+    cg->colorFuncArray[colorFuncIndex].offset   = NULL;
+    cg->colorFuncArray[colorFuncIndex].symmetry = SYMMETRY_NONE;
+    cg->colorFuncArray[colorFuncIndex].name     = strdup (name);
+}
+
+//
+// Fuegt eine Farbfunktion hinzu, die pro Aufruf die 'size' Werte einer
+// ganzen Zeile nach 'row' schreibt.
+//
+void ColorGrid_AddColorFuncRow (ColorGrid cg, ColorRowFunc func, char *name) {
+    int colorFuncIndex;
+
+    assert (cg != NULL);
+    assert ((func != NULL) && (name != NULL));
+
+    colorFuncIndex = cg->numColorFuncs;
+    cg->numColorFuncs++;
+    cg->colorFuncArray = realloc (cg->colorFuncArray, \
+            cg->numColorFuncs * sizeof (ColorFuncType));
+    cg->colorFuncArray[colorFuncIndex].func     = NULL;
+    cg->colorFuncArray[colorFuncIndex].rowFunc  = func;
+    cg->colorFuncArray[colorFuncIndex].expr     = NULL;
+    cg->colorFuncArray[colorFuncIndex].offset   = NULL;
+    cg->colorFuncArray[colorFuncIndex].symmetry = SYMMETRY_NONE;
+    cg->colorFuncArray[colorFuncIndex].name     = strdup (name);
+}
+
+//
+// Fuegt eine Farbfunktion der Form GetColor (cg, color, k(x,y) + step)
+// hinzu. 'func' liefert den Offset k(x,y) und wird nur hier, einmal pro
+// Pixel, aufgerufen.
+//
+void ColorGrid_AddOffsetFunc (ColorGrid cg, ColorOffsetFunc func,
+        char *name) {
+    int colorFuncIndex, *offset;
+    int x, y, p, period;
+
+    assert (cg != NULL);
+    assert ((func != NULL) && (name != NULL));
+
+    period = COLORGRID_PERIOD(cg);
+    offset = calloc (cg->size * cg->size, sizeof (int));
+    for (y=0, p=0; y<cg->size; y++) {
+        for (x=0; x<cg->size; x++, p++) {
+            offset[p] = func (cg, x, y) % period;
+            if (offset[p] < 0) {
+                offset[p] += period;
+            }
+        }
+    }
+
+    colorFuncIndex = cg->numColorFuncs;
+    cg->numColorFuncs++;
+    cg->colorFuncArray = realloc (cg->colorFuncArray, \
+            cg->numColorFuncs * sizeof (ColorFuncType));
+    cg->colorFuncArray[colorFuncIndex].func     = NULL;
+    cg->colorFuncArray[colorFuncIndex].rowFunc  = NULL;
+    cg->colorFuncArray[colorFuncIndex].expr     = NULL;
+    cg->colorFuncArray[colorFuncIndex].offset   = offset;
+    cg->colorFuncArray[colorFuncIndex].symmetry = SYMMETRY_NONE;
+    cg->colorFuncArray[colorFuncIndex].name     = strdup (name);
+}
+
+//
+// Fuegt eine Farbfunktion hinzu, die durch den Ausdruck 'expr' gegeben
+// ist (siehe 'Farbausdruecke'). Liefert den Index der neuen Funktion oder
+// -1, falls der Ausdruck fehlerhaft ist.
+//
+int ColorGrid_AddExprFunc (ColorGrid cg, char *expr, char *name) {
+    ColorExpr ex;
+    int colorFuncIndex;
+
+    assert (cg != NULL);
+    assert ((expr != NULL) && (name != NULL));
+
+    ex = ColorExpr_Compile (cg, expr);
+    if (ex == NULL) {
+        return -1;
+    }
+
+    colorFuncIndex = cg->numColorFuncs;
+    cg->numColorFuncs++;
+    cg->colorFuncArray = realloc (cg->colorFuncArray, \
+            cg->numColorFuncs * sizeof (ColorFuncType));
+    cg->colorFuncArray[colorFuncIndex].func     = NULL;
+    cg->colorFuncArray[colorFuncIndex].rowFunc  = NULL;
+    cg->colorFuncArray[colorFuncIndex].expr     = ex;
+    cg->colorFuncArray[colorFuncIndex].offset   = NULL;
+    cg->colorFuncArray[colorFuncIndex].symmetry = SYMMETRY_NONE;
+    cg->colorFuncArray[colorFuncIndex].name     = strdup (name);
+
+    return colorFuncIndex;
+}
+
+//
+// Liest Farbfunktionen aus der Datei 'fileName'. Jede Zeile hat die Form
+//
+//     Name = Ausdruck
+//
+// Leere Zeilen und Zeilen, die mit '#' beginnen, werden ignoriert, ebenso
+// fehlerhafte Ausdruecke (mit Meldung). Liefert die Anzahl hinzugefuegter
+// Funktionen oder -1, falls die Datei nicht geoeffnet werden kann.
+//
+int ColorGrid_LoadExprFile (ColorGrid cg, char *fileName) {
+    FILE *fd;
+    char line[512], *name, *expr, *end;
+    int num;
+
+    assert (cg != NULL);
+    assert (fileName != NULL);
+
+    fd = fopen (fileName, "r");
+    if (fd == NULL) {
+        return -1;
+    }
+    num = 0;
+    while (fgets (line, sizeof (line), fd) != NULL) {
+        for (name=line; isspace ((unsigned char) *name); name++)
+            ;
+        if ((*name == '\0') || (*name == '#')) {
+            continue;
+        }
+        for (end=name+strlen (name); isspace ((unsigned char) end[-1]);
+                end--)
+            ;
+        *end = '\0';
+        expr = strchr (name, '=');
+        if (expr == NULL) {
+            fprintf (stderr, "ERROR: '=' missing in line '%s'!\n", name);
+            continue;
+        }
+        for (end=expr; (end > name) && isspace ((unsigned char) end[-1]);
+                end--)
+            ;
+        *end = '\0';
+        for (expr++; isspace ((unsigned char) *expr); expr++)
+            ;
+        if (ColorGrid_AddExprFunc (cg, expr, name) >= 0) {
+            num++;
+        }
+    }
+    fclose (fd);
+
+    return num;
+}
+
+//
+// Erklaert die Farbfunktion 'funcIndex' als symmetrisch. Es wird dann nur
+// noch der Grundbereich berechnet (siehe 'LedGrid_SymmetrySource') und in
+// die uebrigen Pixel kopiert. Fuer Funktionen mit Offset-Tabelle hat dies
+// keine Wirkung, da ein Pixel dort nicht mehr kostet als eine Kopie.
+//
+void ColorGrid_SetColorFuncSymmetry (ColorGrid cg, int funcIndex,
+        enum LedGrid_SymmetryEnum sym) {
+    int x, y, sx, sy, nf, nc, c;
+
+    assert (cg != NULL);
+    assert ((funcIndex >= 0) && (funcIndex < cg->numColorFuncs));
+    assert ((sym >= SYMMETRY_NONE) && (sym <= SYMMETRY_OCTANT));
+
+    if ((sym != SYMMETRY_NONE) && (cg->symFund[sym] == NULL)) {
+        cg->symFund[sym] = calloc (cg->size * cg->size, sizeof (int));
+        cg->symCopy[sym] = calloc (2 * cg->size * cg->size, sizeof (int));
+        nf = nc = 0;
+        for (y=0; y<cg->size; y++) {
+            for (x=0; x<cg->size; x++) {
+                LedGrid_SymmetrySource (sym, cg->size, cg->size, x, y,
+                        &sx, &sy);
+                if ((sx == x) && (sy == y)) {
+                    cg->symFund[sym][nf++] = y * cg->size + x;
+                } else {
+                    cg->symCopy[sym][2*nc]   = y * cg->size + x;
+                    cg->symCopy[sym][2*nc+1] = sy * cg->size + sx;
+                    nc++;
+                }
+            }
+        }
+        cg->symNumFund[sym] = nf;
+        cg->symNumCopy[sym] = nc;
+    }
+    cg->colorFuncArray[funcIndex].symmetry = sym;
+    for (c=0; c<3; c++) {
+        if (cg->colorFunc[c] == funcIndex) {
+            ColorGrid_InvalidateCache (cg, c);
+        }
+    }
 }
 
 int ColorGrid_GetNumColorFuncs (ColorGrid cg) {
@@ -1381,6 +5779,23 @@ void ColorGrid_SetImage (ColorGrid cg, int imageIndex, int fadeStep) {
     LedGrid_SetImage (cg->lg, imageIndex, fadeStep);
 }
 
+//
+// Legt fest, in welches Bild 'ColorGrid_SetColors' zeichnet (siehe
+// 'LedGrid_SetDrawImage'); -1 steht fuer das jeweils aktuelle Bild.
+//
+void ColorGrid_SetDrawImage (ColorGrid cg, int imageIndex) {
+    assert (cg != NULL);
+
+    LedGrid_SetDrawImage (cg->lg, imageIndex);
+}
+
+void ColorGrid_Transition (ColorGrid cg, int from, int to, int duration,
+        enum LedGrid_EasingEnum easing) {
+    assert (cg != NULL);
+
+    LedGrid_Transition (cg->lg, from, to, duration, easing);
+}
+
 /*
  * LedRun --
  */
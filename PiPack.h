@@ -9,9 +9,33 @@
 typedef struct Semaphore *Semaphore;
 
 extern Semaphore Semaphore_Init (int count);
+extern void      Semaphore_Free (Semaphore s);
 extern void      Semaphore_P    (Semaphore s);
 extern void      Semaphore_V    (Semaphore s);
 
+/*-----------------------------------------------------------------------------
+ *
+ * PreCache --
+ *
+ *     Binaere Datei mit vorberechneten Tabellen (Gamma, Ease, Farbtabellen
+ *     der ColorGrid), die beim Start eingeblendet wird. Eintraege sind
+ *     nach Art und Parametern verschluesselt; fehlt ein Eintrag, wird die
+ *     Tabelle berechnet und beim naechsten 'PreCache_Save' gespeichert.
+ *
+ */
+enum PreCache_KindEnum {
+    PRECACHE_GAMMA = 1,
+    PRECACHE_EASE,
+    PRECACHE_CURVE
+};
+
+extern int        PreCache_Open (char *fileName);
+extern const void *PreCache_Get (unsigned int kind, const void *key,
+        unsigned int keyLen, unsigned int dataLen);
+extern void       PreCache_Put  (unsigned int kind, const void *key,
+        unsigned int keyLen, const void *data, unsigned int dataLen);
+extern int        PreCache_Save (void);
+
 /*-----------------------------------------------------------------------------
  *
  * Button --
@@ -99,6 +123,10 @@ extern void          LedStrip_SetGreen (LedStrip ls, int pixel,
 extern void          LedStrip_SetBlue (LedStrip ls, int pixel,
         unsigned char blue);
 extern void          LedStrip_SetGamma (LedStrip ls, float gammaValue);
+extern void          LedStrip_SetCalibration (LedStrip ls, int pixel,
+        float red, float green, float blue);
+extern int           LedStrip_LoadCalibration (LedStrip ls, char *fileName);
+extern void          LedStrip_ClearCalibration (LedStrip ls);
 
 extern unsigned char LedStrip_GetColorValue (LedStrip ls, int pixel,
         enum LedStrip_ColorIndexEnum colorIndex);
@@ -132,6 +160,32 @@ enum LedGrid_ShiftDirectionEnum {
     SHIFT_UP, SHIFT_DOWN, SHIFT_LEFT, SHIFT_RIGHT
 };
 
+enum LedGrid_SymmetryEnum {
+    SYMMETRY_NONE, SYMMETRY_MIRROR_X, SYMMETRY_MIRROR_Y, SYMMETRY_QUAD,
+    SYMMETRY_OCTANT
+};
+
+enum LedGrid_BlendModeEnum {
+    BLEND_NORMAL, BLEND_ADD, BLEND_MULTIPLY, BLEND_SCREEN, BLEND_MAX
+};
+
+enum LedGrid_BlurEnum {
+    BLUR_BOX, BLUR_GAUSS
+};
+
+enum LedGrid_EasingEnum {
+    EASE_LINEAR, EASE_IN, EASE_OUT, EASE_IN_OUT
+};
+
+enum LedGrid_TransitionEnum {
+    TRANSITION_FADE,
+    TRANSITION_WIPE_LEFT, TRANSITION_WIPE_RIGHT,
+    TRANSITION_WIPE_UP, TRANSITION_WIPE_DOWN,
+    TRANSITION_IRIS, TRANSITION_DISSOLVE,
+    TRANSITION_SLIDE_LEFT, TRANSITION_SLIDE_RIGHT,
+    TRANSITION_SLIDE_UP, TRANSITION_SLIDE_DOWN
+};
+
 extern LedGrid LedGrid_Init (int sizeX, int sizeY, float gammaValue);
 extern void    LedGrid_Free (LedGrid lg);
 extern void    LedGrid_Show (LedGrid lg);
@@ -146,6 +200,8 @@ extern void    LedGrid_SetGreen (LedGrid lg, int x, int y, unsigned char value);
 extern void    LedGrid_SetBlue (LedGrid lg, int x, int y, unsigned char value);
 extern void    LedGrid_SetColorInt (LedGrid lg, int x, int y, unsigned int value);
 extern void    LedGrid_SetGamma (LedGrid lg, float gammaValue);
+extern int     LedGrid_LoadCalibration (LedGrid lg, char *fileName);
+extern void    LedGrid_ClearCalibration (LedGrid lg);
 
 extern void    LedGrid_SetAllColor (LedGrid lg, unsigned char red,
         unsigned char green, unsigned char blue);
@@ -163,16 +219,43 @@ extern void          LedGrid_AllOn  (LedGrid lg);
 extern void          LedGrid_AllOff (LedGrid lg);
 
 extern int           LedGrid_NewImage (LedGrid lg);
+extern int           LedGrid_NewCanvas (LedGrid lg, int sizeX, int sizeY);
+extern void          LedGrid_SetViewport (LedGrid lg, int x, int y);
+extern void          LedGrid_MoveViewport (LedGrid lg, int dx, int dy);
 extern int           LedGrid_LoadImage (LedGrid lg, char *fileName,
                              int imgIndex);
 extern int           LedGrid_SaveImage (LedGrid lg, char *fileName,
                              int imgIndex);
 extern void          LedGrid_SetImage (LedGrid lg, int imageIndex,
                              int fadeStep);
+extern void          LedGrid_Transition (LedGrid lg, int from, int to,
+                             int duration, enum LedGrid_EasingEnum easing);
+extern void          LedGrid_TransitionEffect (LedGrid lg, int from,
+                             int to, int duration,
+                             enum LedGrid_EasingEnum easing,
+                             enum LedGrid_TransitionEnum effect);
+extern int           LedGrid_InTransition (LedGrid lg);
 extern int           LedGrid_GetImageCount (LedGrid lg);
 extern int           LedGrid_GetCurImage (LedGrid lg);
-
-extern void          LedGrid_FadeImage (LedGrid lg);
+extern void          LedGrid_SetDrawImage (LedGrid lg, int imgIndex);
+extern int           LedGrid_GetDrawImage (LedGrid lg);
+
+extern int           LedGrid_NewLayer (LedGrid lg,
+                             enum LedGrid_BlendModeEnum mode);
+extern int           LedGrid_GetLayerCount (LedGrid lg);
+extern int           LedGrid_GetLayerImage (LedGrid lg, int layer);
+extern void          LedGrid_SetLayerOpacity (LedGrid lg, int layer,
+                             unsigned char opacity);
+extern unsigned char LedGrid_GetLayerOpacity (LedGrid lg, int layer);
+extern void          LedGrid_SetLayerMode (LedGrid lg, int layer,
+                             enum LedGrid_BlendModeEnum mode);
+extern void          LedGrid_SetLayerVisible (LedGrid lg, int layer,
+                             int visible);
+
+extern void          LedGrid_FadeImage (LedGrid lg, int srcImg, int dstImg);
+extern void          LedGrid_SetBlur (LedGrid lg,
+                             enum LedGrid_BlurEnum type, int radius);
+extern void          LedGrid_BlurImage (LedGrid lg, int srcImg, int dstImg);
 extern void          LedGrid_InterpolateImage (LedGrid lg);
 
 extern void          LedGrid_Clear (LedGrid lg);
@@ -180,6 +263,159 @@ extern void          LedGrid_Clear (LedGrid lg);
 extern void          LedGrid_Shift (LedGrid lg,
                              enum LedGrid_ShiftDirectionEnum direction,
                              int rotate);
+extern void          LedGrid_ShiftCount (LedGrid lg,
+                             enum LedGrid_ShiftDirectionEnum direction,
+                             int count, int rotate);
+extern void          LedGrid_Mirror (LedGrid lg,
+                             enum LedGrid_SymmetryEnum sym);
+
+/*-----------------------------------------------------------------------------
+ *
+ * Sprite --
+ *
+ *     Vorbereitete Bitmaps mit Transparenz, die (abgeschnitten) in ein Bild
+ *     eines LedGrid gezeichnet werden.
+ *
+ */
+typedef struct Sprite *Sprite;
+
+extern Sprite Sprite_Init (int sizeX, int sizeY);
+extern Sprite Sprite_Load (char *fileName, unsigned int keyColor);
+extern void   Sprite_Free (Sprite sp);
+
+extern void   Sprite_SetColor (Sprite sp, int x, int y,
+        unsigned char red, unsigned char green, unsigned char blue);
+extern void   Sprite_SetTransparent (Sprite sp, int x, int y);
+extern int    Sprite_GetSizeX (Sprite sp);
+extern int    Sprite_GetSizeY (Sprite sp);
+
+extern void   LedGrid_DrawSprite (LedGrid lg, Sprite sp, int x, int y);
+extern void   LedGrid_DrawSprites (LedGrid lg, Sprite *sp, int *x, int *y,
+        int count);
+
+/*-----------------------------------------------------------------------------
+ *
+ * LedText --
+ *
+ *     Lauftext fuer eine LedGrid. Der Text wird einmal in ein Canvas
+ *     gezeichnet und danach nur noch durch Verschieben des Ausschnitts
+ *     gescrollt.
+ *
+ */
+typedef struct LedText *LedText;
+
+extern LedText LedText_Init (LedGrid lg);
+extern void    LedText_Free (LedText lt);
+
+extern void    LedText_SetText (LedText lt, char *text);
+extern char   *LedText_GetText (LedText lt);
+extern void    LedText_SetColor (LedText lt, unsigned char red,
+        unsigned char green, unsigned char blue);
+extern int     LedText_GetImage (LedText lt);
+
+extern void    LedText_Scroll (LedText lt, int dx);
+extern void    LedText_SetPosition (LedText lt, int x);
+
+/*-----------------------------------------------------------------------------
+ *
+ * Particles --
+ *
+ *     Vorrat fester Groesse an Partikeln, die additiv in ein Bild einer
+ *     LedGrid gezeichnet werden.
+ *
+ */
+typedef struct Particles *Particles;
+
+extern Particles Particles_Init (int capacity);
+extern void      Particles_Free (Particles ps);
+
+extern void      Particles_SetGravity (Particles ps, float gravX, float gravY);
+extern int       Particles_Emit (Particles ps, float x, float y,
+        float velX, float velY, int life,
+        unsigned char red, unsigned char green, unsigned char blue);
+extern int       Particles_GetCount (Particles ps);
+extern void      Particles_Clear (Particles ps);
+extern void      Particles_Update (Particles ps);
+
+extern void      LedGrid_DrawParticles (LedGrid lg, Particles ps);
+
+/*-----------------------------------------------------------------------------
+ *
+ * CellAuto --
+ *
+ *     Zellulaere Automaten (Life und Verwandte) auf bit-gepackten Feldern,
+ *     die auch viel groesser als das Panel sein koennen.
+ *
+ */
+typedef struct CellAuto *CellAuto;
+
+extern CellAuto CellAuto_Init (int sizeX, int sizeY, int wrap);
+extern void     CellAuto_Free (CellAuto ca);
+
+extern void     CellAuto_SetRule (CellAuto ca, unsigned int birth,
+        unsigned int survive);
+extern int      CellAuto_SetRuleString (CellAuto ca, char *rule);
+
+extern void     CellAuto_SetCell (CellAuto ca, int x, int y, int alive);
+extern int      CellAuto_GetCell (CellAuto ca, int x, int y);
+extern void     CellAuto_Clear (CellAuto ca);
+extern void     CellAuto_Randomize (CellAuto ca, float density);
+extern int      CellAuto_GetPopulation (CellAuto ca);
+
+extern void     CellAuto_Step (CellAuto ca);
+
+extern void     LedGrid_DrawCellAuto (LedGrid lg, CellAuto ca,
+        int offX, int offY, unsigned int onColor, unsigned int offColor);
+
+/*-----------------------------------------------------------------------------
+ *
+ * Noise --
+ *
+ *     Dreidimensionales Gradienten-Rauschen (Perlin) in Fixpunkt-Arithmetik,
+ *     zeilen- bzw. bildweise berechnet.
+ *
+ */
+typedef struct Noise *Noise;
+
+extern Noise Noise_Init (unsigned int seed);
+extern void  Noise_Free (Noise n);
+
+extern void  Noise_FillRow (Noise n, int x, int dx, int y, int z, int count,
+        unsigned char *out);
+extern void  Noise_FillFrame (Noise n, unsigned char *out, int sizeX,
+        int sizeY, float scale, float time);
+
+extern void  LedGrid_DrawNoise (LedGrid lg, Noise n, float scale, float time,
+        unsigned int lowColor, unsigned int highColor);
+
+/*-----------------------------------------------------------------------------
+ *
+ * Resampler --
+ *
+ *     Skaliert RGB-Bilder beliebiger Groesse (z.B. von der Kamera) in
+ *     Fixpunkt-Arithmetik auf die Groesse der LedGrid.
+ *
+ */
+typedef struct Resampler *Resampler;
+
+enum Resampler_FilterEnum {
+    RESAMPLER_BOX, RESAMPLER_BILINEAR
+};
+
+enum Resampler_FitEnum {
+    RESAMPLER_STRETCH, RESAMPLER_FILL, RESAMPLER_CONTAIN
+};
+
+extern Resampler Resampler_Init (int srcX, int srcY, int dstX, int dstY,
+        enum Resampler_FilterEnum filter, enum Resampler_FitEnum fit);
+extern void      Resampler_Free (Resampler rs);
+
+extern void      Resampler_SetCrop (Resampler rs, int x, int y, int w, int h);
+extern void      Resampler_Run (Resampler rs, const unsigned char *src,
+        int srcStride, unsigned char *dst, int dstStride);
+
+extern void      LedGrid_DrawResampled (LedGrid lg, Resampler rs,
+        const unsigned char *src, int srcStride, int imgIndex);
 
 /*-----------------------------------------------------------------------------
  *
@@ -191,6 +427,9 @@ extern void          LedGrid_Shift (LedGrid lg,
 typedef struct ColorGrid *ColorGrid;
 typedef unsigned char (ColorFunc) (ColorGrid cg, \
         int color, int x, int y, int step);
+typedef void (ColorRowFunc) (ColorGrid cg, \
+        int color, int y, int step, unsigned char *row);
+typedef int (ColorOffsetFunc) (ColorGrid cg, int x, int y);
 
 extern ColorGrid ColorGrid_Init (int size, int numFadeSteps, float gammaValue);
 extern void ColorGrid_Free (ColorGrid cg);
@@ -203,6 +442,8 @@ extern unsigned char ColorGrid_GetColor (ColorGrid cg, int color, int step);
 extern void ColorGrid_SetFadeIncr (ColorGrid cg, int color, int incr);
 extern int  ColorGrid_GetFadeIncr (ColorGrid cg, int color);
 extern void ColorGrid_IncrFadeIncr (ColorGrid cg, int color, int incrIncr);
+extern void  ColorGrid_SetFadeSpeed (ColorGrid cg, int color, float speed);
+extern float ColorGrid_GetFadeSpeed (ColorGrid cg, int color);
 
 extern void ColorGrid_SetFadeStep (ColorGrid cg, int color, int step);
 extern int  ColorGrid_GetFadeStep (ColorGrid cg, int color);
@@ -211,15 +452,30 @@ extern void ColorGrid_IncrFadeStep (ColorGrid cg, int color, int stepIncr);
 extern void ColorGrid_Fade (ColorGrid cg, int color);
 
 extern void ColorGrid_SetColors (ColorGrid cg);
+extern void ColorGrid_SetCache (ColorGrid cg, int enable);
+extern int  ColorGrid_IsCached (ColorGrid cg, int color);
+extern void ColorGrid_SetThreads (ColorGrid cg, int numThreads);
+extern int  ColorGrid_GetThreads (ColorGrid cg);
 extern void ColorGrid_Show (ColorGrid cg);
 extern void ColorGrid_SetColorFunc (ColorGrid cg, int color, int funcIndex);
 extern int  ColorGrid_GetColorFunc (ColorGrid cg, int color);
 extern char *ColorGrid_GetColorFuncName (ColorGrid cg, int funcIndex);
 extern void ColorGrid_AddColorFunc (ColorGrid cg, ColorFunc func, char *name);
+extern void ColorGrid_AddColorFuncRow (ColorGrid cg, ColorRowFunc func,
+        char *name);
+extern void ColorGrid_AddOffsetFunc (ColorGrid cg, ColorOffsetFunc func,
+        char *name);
+extern int  ColorGrid_AddExprFunc (ColorGrid cg, char *expr, char *name);
+extern int  ColorGrid_LoadExprFile (ColorGrid cg, char *fileName);
+extern void ColorGrid_SetColorFuncSymmetry (ColorGrid cg, int funcIndex,
+        enum LedGrid_SymmetryEnum sym);
 extern int  ColorGrid_GetNumColorFuncs (ColorGrid cg);
 
 extern int  ColorGrid_NewImage (ColorGrid cg);
 extern void ColorGrid_SetImage (ColorGrid cg, int imageIndex, int fadeStep);
+extern void ColorGrid_SetDrawImage (ColorGrid cg, int imageIndex);
+extern void ColorGrid_Transition (ColorGrid cg, int from, int to,
+        int duration, enum LedGrid_EasingEnum easing);
 
 /*-----------------------------------------------------------------------------
  *
@@ -0,0 +1,142 @@
+/*-----------------------------------------------------------------------------
+ *
+ * colorgridBench.c
+ *
+ *     Misst die Dauer von 'ColorGrid_SetColors' mit 1 bis 4 Threads, auf
+ *     dem 10x10 Grid und auf groesseren (virtuellen) Grids. Die Bilder
+ *     werden nicht angezeigt ('ColorGrid_Show' unterstuetzt nur so viele
+ *     LEDs wie am Strip angeschlossen sind), es wird nur die Berechnung
+ *     gemessen.
+ *
+ *     Unter Verwendung von 'ColorGrid' aus dem PiPack.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <libgen.h>
+#include <getopt.h>
+#include "PiPack.h"
+
+#define MAX_THREADS 4
+
+int gridSize;
+
+//
+// Farbfunktionen: eine pro Pixel (teuer), eine pro Zeile und eine mit
+// Offset-Tabelle (billig).
+//
+unsigned char benchPixel (ColorGrid cg, int color, int x, int y, int step) {
+    double dx, dy;
+
+    dx = x - 0.5 * gridSize;
+    dy = y - 0.5 * gridSize;
+    return ColorGrid_GetColor (cg, color,
+            (int) (sqrt (dx*dx + dy*dy) * 10.0 + atan2 (dy, dx) * 20.0)
+            + 1000 + step);
+}
+
+void benchRow (ColorGrid cg, int color, int y, int step, unsigned char *row) {
+    int x;
+
+    for (x=0; x<gridSize; x++) {
+        row[x] = ColorGrid_GetColor (cg, color, x * y + step);
+    }
+}
+
+int benchOffset (ColorGrid cg, int x, int y) {
+    return 10 * (x + y);
+}
+
+double now (void) {
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+//
+// Liefert die Anzahl Bilder pro Sekunde fuer 'numFrames' Bilder.
+//
+double bench (int size, int numThreads, int numFrames, float speed) {
+    ColorGrid cg;
+    double t0, t1;
+    int c, i;
+
+    gridSize = size;
+    cg = ColorGrid_Init (size, 10, 1.0);
+    ColorGrid_AddColorFunc (cg, benchPixel, "Pixel");
+    ColorGrid_AddColorFuncRow (cg, benchRow, "Row");
+    ColorGrid_AddOffsetFunc (cg, benchOffset, "Offset");
+    for (c=0; c<3; c++) {
+        ColorGrid_Recalc (cg, c, 255, 1.5);
+        ColorGrid_SetColorFunc (cg, c, c);
+        ColorGrid_SetFadeSpeed (cg, c, speed);
+    }
+    ColorGrid_SetThreads (cg, numThreads);
+
+    t0 = now ();
+    for (i=0; i<numFrames; i++) {
+        for (c=0; c<3; c++) {
+            ColorGrid_Fade (cg, c);
+        }
+        ColorGrid_SetColors (cg);
+    }
+    t1 = now ();
+
+    ColorGrid_Free (cg);
+    return numFrames / (t1 - t0);
+}
+
+int main (int argc, char *argv[]) {
+    int sizes[] = { 10, 20, 40, 80 };
+    int numFrames = 2000;
+    float speed = 0.5;
+    double fps, base;
+    int opt, s, t;
+
+    void usage () {
+        fprintf (stderr, "usage: %s <options>\n", basename (argv[0]));
+        fprintf (stderr, "  -h        help\n");
+        fprintf (stderr, "  -n <n>    number of frames per run\n");
+        fprintf (stderr, "  -v <n>    fade speed (steps per frame)\n");
+    }
+
+    while ((opt = getopt (argc, argv, "hn:v:")) != -1) {
+        switch (opt) {
+            case 'h':
+                usage ();
+                exit (0);
+                break;
+            case 'n':
+                numFrames = atoi (optarg);
+                break;
+            case 'v':
+                speed = atof (optarg);
+                break;
+            default:
+                usage ();
+                exit (1);
+                break;
+        }
+    }
+
+    printf ("size   threads   frames/s   speedup\n");
+    for (s=0; s<sizeof (sizes) / sizeof (sizes[0]); s++) {
+        base = 0.0;
+        for (t=1; t<=MAX_THREADS; t++) {
+            fps = bench (sizes[s], t, numFrames, speed);
+            if (t == 1) {
+                base = fps;
+            }
+            printf ("%4d   %7d   %8.0f   %7.2f\n", sizes[s], t, fps,
+                    fps / base);
+        }
+    }
+
+    return 0;
+}
@@ -45,53 +45,53 @@ int   fadeSteps;
 //
 // Aus (retourniert immer 0)
 //
-unsigned char colorFunc00 (ColorGrid cg, \
-	int color, int x, int y, int step) {
-    return 0;
+void colorFunc00 (ColorGrid cg, \
+	int color, int y, int step, unsigned char *row) {
+    memset (row, 0, SIZE);
 }
+//
+// Die folgenden Funktionen liefern nur den Offset in die Farbtabelle, der
+// zum aktuellen Schritt addiert wird (siehe 'ColorGrid_AddOffsetFunc').
+// Sie werden beim Start einmal pro Pixel aufgerufen.
+//
+
 //
 // Fade der ganzen Flaeche
 //
-unsigned char colorFunc99 (ColorGrid cg, \
-	int color, int x, int y, int step) {
-    return ColorGrid_GetColor (cg, color, step);
+int colorFunc99 (ColorGrid cg, int x, int y) {
+    return 0;
 }
 //
 // X-Achse
 //
-unsigned char colorFunc10 (ColorGrid cg, \
-	int color, int x, int y, int step) {
-    return ColorGrid_GetColor (cg, color, x*fadeSteps+step);
+int colorFunc10 (ColorGrid cg, int x, int y) {
+    return x*fadeSteps;
 }
 //
 // Y-Achse
 //
-unsigned char colorFunc15 (ColorGrid cg, \
-	int color, int x, int y, int step) {
-    return ColorGrid_GetColor (cg, color, y*fadeSteps+step);
+int colorFunc15 (ColorGrid cg, int x, int y) {
+    return y*fadeSteps;
 }
 //
 // Diagonal (links unten - rechts oben)
 //
-unsigned char colorFunc20 (ColorGrid cg, \
-        int color, int x, int y, int step) {
-    return ColorGrid_GetColor (cg, color, (x+y)*fadeSteps+step);
+int colorFunc20 (ColorGrid cg, int x, int y) {
+    return (x+y)*fadeSteps;
 }
 //
 // Diagonal (links oben - rechts unten)
 //
-unsigned char colorFunc25 (ColorGrid cg, \
-        int color, int x, int y, int step) {
-    return ColorGrid_GetColor (cg, color, (SIZE+x-1-y)*fadeSteps+step);
+int colorFunc25 (ColorGrid cg, int x, int y) {
+    return (SIZE+x-1-y)*fadeSteps;
 }
 //
 // Karo
 //
-unsigned char colorFunc30 (ColorGrid cg, \
-        int color, int x, int y, int step) {
+int colorFunc30 (ColorGrid cg, int x, int y) {
     x = (x<SIZE/2) ? x : SIZE-x-1;
     y = (y<SIZE/2) ? y : SIZE-y-1;
-    return ColorGrid_GetColor (cg, color, (x+y)*fadeSteps+step);
+    return (x+y)*fadeSteps;
 }
 //
 // Quadrat
@@ -104,50 +104,42 @@ int min (int a, int b) {
     }
 }
 
-unsigned char colorFunc35 (ColorGrid cg, \
-        int color, int x, int y, int step) {
+int colorFunc35 (ColorGrid cg, int x, int y) {
     x = (x<SIZE/2) ? x : SIZE-x-1;
     y = (y<SIZE/2) ? y : SIZE-y-1;
-    return ColorGrid_GetColor (cg, color, 2*min(x,y)*fadeSteps+step);
+    return 2*min(x,y)*fadeSteps;
 }
 //
 // Kreis
 //
-unsigned char colorFunc40 (ColorGrid cg, \
-        int color, int x, int y, int step) {
+int colorFunc40 (ColorGrid cg, int x, int y) {
     int v;
     x = (x<SIZE/2) ? (SIZE/2-x-1) : x-SIZE/2;
     y = (y<SIZE/2) ? (SIZE/2-y-1) : y-SIZE/2;
     v = round (sqrt (x*x + y*y));
-    return ColorGrid_GetColor (cg, color, 2*v*fadeSteps+step);
+    return 2*v*fadeSteps;
 }
 
 //
 // Linie auf Y-Achse
 //
-unsigned char colorFunc50 (ColorGrid cg, \
-        int color, int x, int y, int step) {
-    int v;
-    v = (x*fadeSteps+step)%(2*(SIZE-1)*SIZE);
-    if ((v < 10) || ((v >= 90) && (v < 100))) {
-        return 255;
-    } else {
-        return 0;
+void colorFunc50 (ColorGrid cg, \
+        int color, int y, int step, unsigned char *row) {
+    int x, v;
+    for (x=0; x<SIZE; x++) {
+        v = (x*fadeSteps+step)%(2*(SIZE-1)*SIZE);
+        row[x] = ((v < 10) || ((v >= 90) && (v < 100))) ? 255 : 0;
     }
 }
 
 //
-// Linie auf X-Achse
+// Linie auf X-Achse (der Wert ist fuer die ganze Zeile gleich)
 //
-unsigned char colorFunc51 (ColorGrid cg, \
-        int color, int x, int y, int step) {
+void colorFunc51 (ColorGrid cg, \
+        int color, int y, int step, unsigned char *row) {
     int v;
     v = (y*fadeSteps+step)%(2*(SIZE-1)*SIZE);
-    if ((v < 10) || ((v >= 90) && (v < 100))) {
-        return 255;
-    } else {
-        return 0;
-    }
+    memset (row, ((v < 10) || ((v >= 90) && (v < 100))) ? 255 : 0, SIZE);
 }
 
 //-----------------------------------------------------------------------------
@@ -163,6 +155,8 @@ int main (int argc, char *argv[]) {
     float expRedValue   = 1.0;
     float expGreenValue = 1.0;
     float expBlueValue  = 1.0;
+    int   useCache      = 0;
+    int   numThreads    = 1;
 
     enum ModeEnum { MAIN_MODE, CMD_MODE, COLOR_MODE, FUNC_MODE, VALUE_MODE, \
             RANDOM_MODE, SAVE_MODE, SPEED_MODE, STEP_MODE };
@@ -204,7 +198,8 @@ int main (int argc, char *argv[]) {
     //
     void *RandomThreadFunc (void *arg) {
         ColorGrid cg;
-        int fade, incr, shift;
+        float speed;
+        int shift;
 
         cg = (ColorGrid) arg;
         if (animationRunning) {
@@ -216,7 +211,7 @@ int main (int argc, char *argv[]) {
             printw ("----------------------------------------------\n");
             for (colorIndex=0; colorIndex<3; colorIndex++) {
                 funcIndex = random () % ColorGrid_GetNumColorFuncs (cg);
-                incr      = random () % 5 - 2;
+                speed     = (random () % 41 - 20) / 10.0;
                 shift     = random () % 2;
                 switch (colorIndex) {
                     case 0:
@@ -229,10 +224,10 @@ int main (int argc, char *argv[]) {
                         printw ("blue  ");
                         break;
                 }
-                printw ("(%+2d, %d): %s\n", incr, shift, \
+                printw ("(%+4.1f, %d): %s\n", speed, shift, \
                         ColorGrid_GetColorFuncName (cg, funcIndex));
                 ColorGrid_SetColorFunc (cg, colorIndex, funcIndex);
-                ColorGrid_SetFadeIncr (cg, colorIndex, incr);
+                ColorGrid_SetFadeSpeed (cg, colorIndex, speed);
                 ColorGrid_IncrFadeStep (cg, colorIndex, 90 * shift);
             }
             printw ("----------------------------------------------\n");
@@ -243,23 +238,16 @@ int main (int argc, char *argv[]) {
             refresh ();
             animationRunning = 1;
             pthread_mutex_unlock (&animRunMutex);
-            for (fade=100; fade>=0; fade--) {
-                ColorGrid_SetImage (cg, 0, fade);
-                // ColorGrid_SetColors (cg);
-                // ColorGrid_Show (cg);
-                delay (40);
-            }
+            ColorGrid_Transition (cg, 1, 0, 4000, EASE_IN_OUT);
+            delay (4000);
             printw ("Let it run...\n");
             refresh ();
             delay (6000);
             printw ("Fade out...\n");
             refresh ();
-            for (fade=0; fade<=100; fade++) {
-                ColorGrid_SetImage (cg, 0, fade);
-                // ColorGrid_SetColors (cg);
-                // ColorGrid_Show (cg);
-                delay (40);
-            }
+            ColorGrid_Transition (cg, 0, 1, 4000, EASE_IN_OUT);
+            delay (4000);
+            ColorGrid_SetImage (cg, 0, 100);
             animationRunning = 0;
             delay (500);
         }
@@ -319,6 +307,7 @@ int main (int argc, char *argv[]) {
         ColorGrid_SetColors (cg);
         ColorGrid_Show (cg);
         delay (delayTime);
+        PreCache_Save ();
         ColorGrid_Free (cg);
         exit (0);
     }
@@ -326,13 +315,17 @@ int main (int argc, char *argv[]) {
     int opt;
     int optionIndex;
     static struct option longOptions[] = {
+        {"cache",    no_argument,       0, 'c' },
         {"delay",    required_argument, 0, 'd' },
+        {"expr",     required_argument, 0, 'e' },
         {"expRed",   required_argument, 0, 'R' },
         {"expGreen", required_argument, 0, 'G' },
         {"expBlue",  required_argument, 0, 'B' },
         {"file",     required_argument, 0, 'f' },
         {"gamma",    required_argument, 0, 'g' },
         {"help",     no_argument,       0, 'h' },
+        {"precache", required_argument, 0, 'p' },
+        {"threads",  required_argument, 0, 'j' },
         {"steps",    required_argument, 0, 's' },
         {"target",   required_argument, 0, 't' },
         {0,          0,                 0, 0   }
@@ -340,6 +333,8 @@ int main (int argc, char *argv[]) {
 
     char targetDir[PATH_MAX];
     char fileName[PATH_MAX];
+    char exprFileName[PATH_MAX];
+    char preCacheName[PATH_MAX];
 
     void usage () {
         fprintf (stderr, "usage: %s <options>\n", basename (argv[0]));
@@ -347,9 +342,13 @@ int main (int argc, char *argv[]) {
         fprintf (stderr, "  -R <n>    --expRed=<n>\n");
         fprintf (stderr, "  -G <n>    --expGreen=<n>\n");
         fprintf (stderr, "  -B <n>    --expBlue=<n>\n");
+        fprintf (stderr, "  -c        --cache\n");
         fprintf (stderr, "  -d <n>    --delay=<n>\n");
+        fprintf (stderr, "  -e <file> --expr=<file>\n");
         fprintf (stderr, "  -f <file> --file=<file>\n");
         fprintf (stderr, "  -g <n>    --gamma=<n>\n");
+        fprintf (stderr, "  -j <n>    --threads=<n>\n");
+        fprintf (stderr, "  -p <file> --precache=<file>\n");
         fprintf (stderr, "  -s <n>    --steps=<n>\n");
         fprintf (stderr, "  -t <dir>  --target=<dir>\n");
     }
@@ -369,13 +368,21 @@ int main (int argc, char *argv[]) {
     delayTime = DefaultDelayTime;
     fadeSteps = DefaultFadeSteps;
     strcpy (targetDir, "images");
+    exprFileName[0] = '\0';
+    strcpy (preCacheName, "ledgrid11.cache");
 
-    while ((opt = getopt_long (argc, argv, "d:f:g:hs:t:R:G:B:", longOptions, \
+    while ((opt = getopt_long (argc, argv, "cd:e:f:g:hj:p:s:t:R:G:B:", longOptions, \
             &optionIndex)) != -1) {
         switch (opt) {
+            case 'c':
+                useCache = 1;
+                break;
             case 'd':
                 delayTime = atoi (optarg);
                 break;
+            case 'e':
+                strcpy (exprFileName, optarg);
+                break;
             case 'R':
                 expRedValue = atof (optarg);
                 break;
@@ -395,6 +402,12 @@ int main (int argc, char *argv[]) {
                 usage ();
                 exit (0);
                 break;
+            case 'j':
+                numThreads = atoi (optarg);
+                break;
+            case 'p':
+                strcpy (preCacheName, optarg);
+                break;
             case 's':
                 fadeSteps = atoi (optarg);
                 break;
@@ -424,22 +437,46 @@ int main (int argc, char *argv[]) {
     keypad (stdscr, TRUE);
     noecho ();
 
+    // Precomputed tables (gamma, curves) from the last run. Missing
+    // tables are computed and saved once the grid is set up.
+    //
+    PreCache_Open (preCacheName);
+
     cg = ColorGrid_Init (DefaultSize, fadeSteps, gammaValue);
 
+    // Image 1 stays black and is only used as the source/target of the
+    // fade in/out transitions. The pattern is always drawn into image 0,
+    // even while a transition has already made image 1 the current one.
+    //
     ColorGrid_NewImage (cg);
-
-    ColorGrid_AddColorFunc (cg, colorFunc00, "Off");
-    ColorGrid_AddColorFunc (cg, colorFunc10, "Fade along x axis");
-    ColorGrid_AddColorFunc (cg, colorFunc15, "Fade along y axis");
-    ColorGrid_AddColorFunc (cg, colorFunc20, "Diagonal (links unten - rechts oben)");
-    ColorGrid_AddColorFunc (cg, colorFunc25, "Diagonal (links oben - rechts unten)");
-    ColorGrid_AddColorFunc (cg, colorFunc30, "Karo");
-    ColorGrid_AddColorFunc (cg, colorFunc35, "Quadrat");
-    ColorGrid_AddColorFunc (cg, colorFunc40, "Kreis");
-    ColorGrid_AddColorFunc (cg, colorFunc99, "Fade der ganzen Flaeche");
-
-    ColorGrid_AddColorFunc (cg, colorFunc50, "Line on y axis");
-    ColorGrid_AddColorFunc (cg, colorFunc51, "Line on x axis");
+    ColorGrid_SetDrawImage (cg, 0);
+
+    ColorGrid_AddColorFuncRow (cg, colorFunc00, "Off");
+    ColorGrid_AddOffsetFunc (cg, colorFunc10, "Fade along x axis");
+    ColorGrid_AddOffsetFunc (cg, colorFunc15, "Fade along y axis");
+    ColorGrid_AddOffsetFunc (cg, colorFunc20, "Diagonal (links unten - rechts oben)");
+    ColorGrid_AddOffsetFunc (cg, colorFunc25, "Diagonal (links oben - rechts unten)");
+    ColorGrid_AddOffsetFunc (cg, colorFunc30, "Karo");
+    ColorGrid_AddOffsetFunc (cg, colorFunc35, "Quadrat");
+    ColorGrid_AddOffsetFunc (cg, colorFunc40, "Kreis");
+    ColorGrid_AddOffsetFunc (cg, colorFunc99, "Fade der ganzen Flaeche");
+
+    ColorGrid_AddColorFuncRow (cg, colorFunc50, "Line on y axis");
+    ColorGrid_AddColorFuncRow (cg, colorFunc51, "Line on x axis");
+    ColorGrid_SetColorFuncSymmetry (cg, ColorGrid_GetNumColorFuncs (cg)-2,
+            SYMMETRY_MIRROR_Y);
+
+    // Additional color functions given as expressions in a file (one per
+    // line: 'Name = Expression').
+    //
+    if (exprFileName[0] != '\0') {
+        if (ColorGrid_LoadExprFile (cg, exprFileName) < 0) {
+            endwin ();
+            fprintf (stderr, "ERROR: couldn't open file '%s'!\n",
+                    exprFileName);
+            exit (1);
+        }
+    }
 
     ColorGrid_SetColorFunc (cg, 0, 0);
     ColorGrid_SetColorFunc (cg, 1, 0);
@@ -449,6 +486,14 @@ int main (int argc, char *argv[]) {
     ColorGrid_Recalc (cg, 1, 255, expGreenValue);
     ColorGrid_Recalc (cg, 2, 255, expBlueValue);
 
+    if (useCache) {
+        ColorGrid_SetCache (cg, 1);
+    }
+    if (numThreads > 1) {
+        ColorGrid_SetThreads (cg, numThreads);
+    }
+    PreCache_Save ();
+
     running          = 1;
     animationRunning = 0;
 #ifdef HAS_PHOTO_SENSOR
@@ -491,8 +536,8 @@ int main (int argc, char *argv[]) {
                             printw ("Blue : ");
                             break;
                     }
-                    printw ("%3d %+2d", ColorGrid_GetFadeStep (cg, i), \
-                            ColorGrid_GetFadeIncr (cg, i));
+                    printw ("%3d %+4.1f", ColorGrid_GetFadeStep (cg, i), \
+                            ColorGrid_GetFadeSpeed (cg, i));
                     funcIndex = ColorGrid_GetColorFunc (cg, i);
                     printw (" (%s)\n", \
                             ColorGrid_GetColorFuncName (cg, funcIndex));